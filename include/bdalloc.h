@@ -1,12 +1,23 @@
 #include <stdint.h>
 
+#ifdef BDALLOC_CONCURRENT
+#include <pthread.h>
+#endif
+
 #ifndef _BD_ALLOC_H
 #define _BD_ALLOC_H 1
-#endif
 
 // Up to 4GB of memory
 #define _BD_MAX_MEM_ORDER 32
 
+// Buckets in the large-allocation registry (Linux passthrough)
+#define _BD_LARGE_BUCKETS 64
+
+/* Compile with -DBDALLOC_HARDENED for corruption detection cheap enough to
+ * leave on in canary deployments: live headers carry an order-keyed canary
+ * validated on free (catching double frees and stray writes into the header)
+ * and freed blocks have their first bytes poisoned with 0xBD. */
+
 /* Inform C++, that we are in C land */
 #ifdef __cplusplus
 extern "C" {
@@ -17,28 +28,410 @@ typedef struct freelist_t {
   struct freelist_t *next;
 } freelist_t;
 
+/* One order's freelist head and block count, packed side by side: every
+ * operation that reads a head also reads (or writes) the count, and the
+ * split loop descending the orders walks adjacent memory -- four orders per
+ * cache line -- instead of hopping between two separate 256-byte arrays. */
+typedef struct bdorder_t {
+  freelist_t *head;
+  uint64_t count;
+} bdorder_t;
+
+/* Callbacks for custom arena backing memory (e.g. mmap with huge pages, shm,
+ * NUMA-bound regions). map returns SIZE bytes or NULL on failure; unmap
+ * releases them. The user pointer is passed through untouched. */
+typedef void *(*bdalloc_map_fn)(uint64_t size, void *user);
+typedef void (*bdalloc_unmap_fn)(void *addr, uint64_t size, void *user);
+
 typedef struct bdalloc_t {
   void *arena;
   uint64_t size;
 
-  // 256B overhead
-  freelist_t *blocks[_BD_MAX_MEM_ORDER];
+  // Out-of-band buddy state: one bit per buddy pair per order, kept in sync
+  // with orders[] so coalescing never has to probe a buddy's (cold) header
+  // line inside the arena. See bdalloc.c for the exact encoding.
+  uint64_t *pair_bits;
+
+  // Occupancy bitmask: bit i is set iff orders[i] is non-empty, so the
+  // smallest sufficient order is one find-first-set away instead of a linear
+  // scan. Placed right before orders[] so the mask and the first heads share
+  // a line.
+  uint64_t order_mask;
+
+  // Per-order freelist heads and counts, 512B
+  bdorder_t orders[_BD_MAX_MEM_ORDER];
+
+  // When non-zero, frees defer coalescing until an order's freelist grows
+  // past this many blocks (or an allocation fails). See
+  // bdalloc_set_lazy_coalesce.
+  uint64_t lazy_watermark;
+
+  // When non-zero, a single free merges at most this many levels upward,
+  // parking the partial result on a freelist for a later pass. See
+  // bdalloc_set_max_merge_levels.
+  uint64_t max_merge_levels;
+
+  // When non-zero, a free that leaves more than this many bytes sitting free
+  // in the arena triggers a trim of the excess. See
+  // bdalloc_set_trim_watermark (Linux only; ignored elsewhere).
+  uint64_t trim_watermark;
+
+  // Instrumentation counters, bumped inline on the alloc/free paths (no
+  // freelist walking). Read through bdalloc_stats.
+  uint64_t bytes_in_use;
+  uint64_t peak_in_use;
+  uint64_t split_count;
+  uint64_t coalesce_count;
+
+  // Multi-arena support: when growable is set, exhausting this arena chains
+  // a fresh one (doubling sizes) here instead of failing the allocation, and
+  // frees are routed to the owning arena by address range. See
+  // bdalloc_set_growable.
+  struct bdalloc_t *next_arena;
+  int growable;
+
+  // Per-order reserved pools for latency-bound callers: pre-split blocks
+  // pinned off the buddy machinery (detached, so coalescing and sweeps can
+  // never absorb them), popped ahead of everything else in bdalloc and
+  // refilled by same-order frees up to the target. See bdalloc_reserve.
+  bdorder_t reserve[_BD_MAX_MEM_ORDER];
+  uint64_t reserve_target[_BD_MAX_MEM_ORDER];
+
+  // The unconsumed range of an active bump region (see bdalloc_bump_begin);
+  // bump_cur is NULL when no region is active.
+  char *bump_cur;
+  char *bump_end;
+
+  // Recorded freelist state for bdalloc_epoch_begin/reset; NULL outside an
+  // epoch. Owned by the allocator, released by bdalloc_epoch_end (or deinit).
+  struct bdalloc_epoch_t *epoch;
+
+  // Backing-memory callbacks; NULL means malloc/free. foreign_arena marks
+  // caller-provided memory that deinit must leave alone.
+  bdalloc_map_fn map;
+  bdalloc_unmap_fn unmap;
+  void *map_user;
+  int foreign_arena;
+
+#ifdef __linux__
+  // Registry of passthrough allocations: requests above the top order of
+  // every arena in the chain go straight to mmap and are recorded here,
+  // hashed by address, so bdalloc_free can route them to munmap. Huge
+  // transient buffers thus never compete with (or fragment) the arena.
+  struct bdalloc_large_t *large[_BD_LARGE_BUCKETS];
+  uint64_t large_bytes;
+
+  // One bit per arena page, set while the free block starting at that page
+  // has had its interior advised away by bdalloc_trim, plus the advised
+  // bytes still decommitted -- so repeat trims (and the automatic watermark
+  // probe on the free path) only ever touch the delta.
+  uint64_t *trim_bits;
+  uint64_t trimmed_bytes;
+#endif
+
+#ifdef BDALLOC_CONCURRENT
+  // One lock per order, so threads splitting and coalescing on different
+  // orders of orders[] never serialize against each other. The list surgery
+  // in bdalloc.c only ever holds one of these at a time, which rules out
+  // deadlock by construction.
+  pthread_mutex_t order_locks[_BD_MAX_MEM_ORDER];
+
+  // serializes growing the arena chain and the large-allocation registry
+  pthread_mutex_t grow_lock;
+#endif
 } bdalloc_t;
 
 /* Initialize the allocator with the size. Returns a pointer to the inner arena
  */
 extern void *bdalloc_init(bdalloc_t *allocator, uint64_t size);
 
-/* Allocate SIZE bytes of memory */
+/* Allocate SIZE bytes of memory. On Linux a request too large for every
+ * arena in the chain passes through to a dedicated mmap (tracked in the
+ * registry, freed through `bdalloc_free` like everything else), so one API
+ * covers all sizes. */
 extern void *bdalloc(bdalloc_t *allocator, uint64_t size);
 
 /* Free a block allocated by `bdalloc`. This only returns the block to the
  * allocator */
 extern void bdalloc_free(bdalloc_t *allocator, void *block);
 
+/* Initialize the allocator with an arena obtained from the given map/unmap
+ * callbacks instead of malloc. Grown arenas (see bdalloc_set_growable) use
+ * the same callbacks. */
+extern void *bdalloc_init_backed(bdalloc_t *allocator, uint64_t size,
+                                 bdalloc_map_fn map, bdalloc_unmap_fn unmap,
+                                 void *user);
+
+/* Adopt caller-provided MEM of SIZE bytes (a power of two, at least the
+ * minimum block size) as the arena. The memory is never released by
+ * bdalloc_deinit; its lifetime belongs to the caller. */
+extern void *bdalloc_init_arena(bdalloc_t *allocator, void *mem,
+                                uint64_t size);
+
+#ifdef __linux__
+/* Initialize the allocator with an mmap'd arena. Pass non-zero HUGE to
+ * request MAP_HUGETLB pages (cuts dTLB misses on large arenas), falling back
+ * to normal pages when no huge pages are reserved. */
+extern void *bdalloc_init_mmap(bdalloc_t *allocator, uint64_t size, int huge);
+
+/* Release the physical pages of free high-order blocks back to the OS with
+ * madvise(MADV_DONTNEED), largest first, until at least TARGET_BYTES have
+ * been released (0 = everything releasable). The first page of each block
+ * stays resident so the freelist node survives; reusing a trimmed block just
+ * faults in zero pages. Blocks already trimmed and untouched since are
+ * skipped, so repeat calls advise only the delta. Returns the bytes newly
+ * advised. */
+extern uint64_t bdalloc_trim(bdalloc_t *allocator, uint64_t target_bytes);
+
+/* Automatic trimming: after a free, if more than WATERMARK bytes of the
+ * arena sit free and still resident, the excess is trimmed immediately.
+ * Sized for the steady state so that only post-spike frees pay the madvise
+ * calls: once the excess is decommitted, further frees cost one compare.
+ * 0 (the default) disables it. */
+extern void bdalloc_set_trim_watermark(bdalloc_t *allocator,
+                                       uint64_t watermark);
+
+/* Write a checkpoint of the allocator (arena, freelists as relocatable
+ * offsets, bitmap, counters) to FD. The allocator must be a single arena --
+ * no grown chain -- and stays fully usable afterwards. Returns 0, or -1 on a
+ * short write. */
+extern int bdalloc_snapshot(bdalloc_t *allocator, int fd);
+
+/* Rebuild an allocator from a checkpoint at FD's current offset (which must
+ * be page-aligned; 0 for a dedicated file). The arena is mapped MAP_PRIVATE
+ * straight out of the file, so restart costs one mmap and pages fault in
+ * lazily; live block pointers from the snapshotted process translate by
+ * arena-relative offset. Returns the arena, or NULL on a bad checkpoint. */
+extern void *bdalloc_restore(bdalloc_t *allocator, int fd);
+#endif
+
+/* Allow the allocator to acquire additional arenas (with a doubling size
+ * policy) when an allocation cannot be satisfied, instead of returning NULL.
+ * Lets deployments start with a small arena and grow under load rather than
+ * sizing for the worst case up front. */
+extern void bdalloc_set_growable(bdalloc_t *allocator, int growable);
+
+/* Enable lazy coalescing: frees just push onto the order's freelist, and
+ * merging runs only once a freelist holds more than WATERMARK blocks, or when
+ * an allocation cannot be satisfied. This trades a little fragmentation for
+ * not paying split+merge on every operation when the same block size is
+ * repeatedly allocated and freed. A WATERMARK of 0 restores eager coalescing
+ * (the default). */
+extern void bdalloc_set_lazy_coalesce(bdalloc_t *allocator,
+                                      uint64_t watermark);
+
+/* Carve the largest free block into a linear bump region: while it is
+ * active, every allocation that fits is served by a pointer increment -- no
+ * occupancy scan, no split cascade -- which is what a monotonic startup
+ * phase wants. The blocks handed out are still naturally aligned and carry
+ * ordinary headers, so they are freed through `bdalloc_free` like any other
+ * block (typically at shutdown) and coalesce normally. Alignment holes
+ * between differently sized allocations are published straight back to the
+ * freelists. Returns -1 when a region is already active or nothing is free.
+ * The bump window itself is not thread-safe; start and seal it while no
+ * other thread is allocating. */
+extern int bdalloc_bump_begin(bdalloc_t *allocator);
+
+/* Seal the active bump region, decomposing the unused tail into
+ * power-of-two blocks on the freelists. Allocations made from the region
+ * stay live. */
+extern void bdalloc_bump_end(bdalloc_t *allocator);
+
+/* Pin COUNT pre-split blocks of ORDER for O(1) worst-case allocation: a
+ * `bdalloc` of a reserved order is one freelist pop -- no occupancy scan, no
+ * split cascade -- and a free of that order refills the pool (also O(1), no
+ * coalescing) until it is back at COUNT. The splitting cost is paid here,
+ * once, at setup time. Reserved blocks are invisible to coalescing and
+ * counted as in-use until released; COUNT is absolute, so a smaller value
+ * (or 0) returns the excess to the buddy system. Returns the pool size
+ * actually reached, short only when the arena cannot supply it. */
+extern uint64_t bdalloc_reserve(bdalloc_t *allocator, uint64_t order,
+                                uint64_t count);
+
+/* Bound the worst-case latency of a single free: coalescing climbs at most
+ * LEVELS orders per call, parking partially merged blocks on the freelists.
+ * Deferred merges are finished by the lazy-coalescing sweeps and by the full
+ * merge pass an allocation failure triggers, so top-order blocks remain
+ * recoverable. A LEVELS of 0 restores unbounded merging (the default). */
+extern void bdalloc_set_max_merge_levels(bdalloc_t *allocator,
+                                         uint64_t levels);
+
+/* Allocate SIZE bytes with no per-block header: the block state lives
+ * entirely in the out-of-band bitmap, so the caller gets the full power of
+ * two (e.g. a 64-byte request costs 64 bytes, not 128). The returned pointer
+ * is the naturally positioned block itself and MUST be freed through
+ * `bdalloc_free_sized` with the same size -- mixing with `bdalloc_free`
+ * corrupts the allocator. */
+extern void *bdalloc_sized(bdalloc_t *allocator, uint64_t size);
+
+/* Free a block allocated by `bdalloc_sized` with the same SIZE */
+extern void bdalloc_free_sized(bdalloc_t *allocator, void *block,
+                               uint64_t size);
+
+/* Allocate SIZE bytes whose address is a multiple of ALIGNMENT (a power of
+ * two, up to a page). Like `bdalloc_sized` the block carries no header, so
+ * e.g. a 4KB-aligned 4KB DMA buffer costs 4KB, not a whole extra order. Free
+ * through `bdalloc_free_aligned` with the same alignment and size. */
+extern void *bdalloc_aligned(bdalloc_t *allocator, uint64_t alignment,
+                             uint64_t size);
+
+/* Free a block allocated by `bdalloc_aligned` with the same ALIGNMENT and
+ * SIZE */
+extern void bdalloc_free_aligned(bdalloc_t *allocator, void *block,
+                                 uint64_t alignment, uint64_t size);
+
+/* Resize a block allocated by `bdalloc`. Growing first tries to absorb the
+ * block's free buddy repeatedly so the data never moves; shrinking splits the
+ * block in place and returns the upper halves to the freelists. Only when
+ * in-place resizing is impossible does this fall back to
+ * allocate-copy-free. mmap passthrough blocks are resized with mremap (the
+ * pointer may move, the data never copies). Follows realloc conventions for
+ * NULL and size 0. */
+extern void *bdalloc_realloc(bdalloc_t *allocator, void *ptr,
+                             uint64_t new_size);
+
+/* Allocate N blocks of SIZE bytes each into OUT, paying the size-to-order
+ * math once for the whole batch. Returns how many blocks were produced
+ * (short on exhaustion); each one is freed like any `bdalloc` block. */
+extern uint64_t bdalloc_bulk(bdalloc_t *allocator, uint64_t size, void **out,
+                             uint64_t n);
+
+/* Free N blocks allocated by `bdalloc` in one batch: the pointers are sorted
+ * by address, pushed onto their freelists without intermediate merging, and
+ * coalesced in a single deferred pass -- so buddies freed in the same batch
+ * merge directly instead of bouncing through split/merge cycles. mmap
+ * passthrough blocks may be mixed into the batch. Reorders PTRS in place. */
+extern void bdalloc_free_bulk(bdalloc_t *allocator, void **ptrs, uint64_t n);
+
+/* Begin an epoch: record which blocks are free right now. Everything
+ * allocated afterwards can then be thrown away wholesale with
+ * `bdalloc_epoch_reset` -- buddy discipline between epochs, bump-free
+ * semantics within one. Single arena only (no grown chain). Replaces any
+ * prior epoch. Returns 0, or -1 when out of memory. */
+extern int bdalloc_epoch_begin(bdalloc_t *allocator);
+
+/* Discard every allocation made since `bdalloc_epoch_begin`: the freelists,
+ * pair bitmap and occupancy mask are rebuilt from the recording in O(blocks
+ * free at begin), independent of how many allocations, splits and merges
+ * happened since. Blocks already live at begin are untouched. The epoch stays
+ * armed, so a request loop pays one begin and then resets per request. */
+extern void bdalloc_epoch_reset(bdalloc_t *allocator);
+
+/* Close the current epoch and release its recording without resetting;
+ * everything allocated during the epoch simply stays allocated. */
+extern void bdalloc_epoch_end(bdalloc_t *allocator);
+
+/* A point-in-time snapshot of the allocator's health, aggregated over the
+ * whole arena chain. Byte figures count the rounded power-of-two block sizes,
+ * i.e. what the allocator actually committed, not what callers asked for. */
+typedef struct bdalloc_stats_t {
+  uint64_t bytes_in_use;
+  uint64_t peak_in_use;
+
+  // bytes sitting on the freelists, in total and broken down by order
+  uint64_t bytes_free;
+  uint64_t free_bytes_per_order[_BD_MAX_MEM_ORDER];
+
+  // lifetime block splits and buddy merges
+  uint64_t split_count;
+  uint64_t coalesce_count;
+
+  // bytes held by mmap passthrough allocations (always 0 off Linux); these
+  // live outside the arena and are not part of bytes_in_use
+  uint64_t large_bytes;
+
+  // free blocks whose buddy is not also free at the same order, i.e. merges
+  // currently blocked by a live (or further-split) buddy. Counted by scanning
+  // the whole pair bitmap -- build with SIMD=avx2 or SIMD=neon to vectorize
+  // the scan on multi-gigabyte arenas.
+  uint64_t open_pairs;
+
+  // 0 when all free memory is one block, approaching 1 as it shatters:
+  // 1 - largest_free_block / bytes_free. Alert on this before allocations of
+  // large orders start failing.
+  double fragmentation;
+} bdalloc_stats_t;
+
+/* Fill OUT from the per-arena counters plus one pass over the pair bitmap
+ * for open_pairs; never walks a freelist.
+ * The counters are maintained without atomics, so under BDALLOC_CONCURRENT
+ * the snapshot is approximate (fine for sizing and alerting). */
+extern void bdalloc_stats(bdalloc_t *allocator, bdalloc_stats_t *out);
+
+/* The arena in the allocator's chain whose address range contains PTR, or
+ * NULL. Layers above the allocator (e.g. the slab cache) use this to turn an
+ * object pointer back into arena-relative coordinates. */
+extern bdalloc_t *bdalloc_owning_arena(bdalloc_t *allocator, void *ptr);
+
+/* The order a request for SIZE bytes will be rounded up to */
+extern uint64_t bdalloc_alloc_order(uint64_t size);
+
+/* Allocate a block of exactly ORDER (2^ORDER bytes, 8 of them header),
+ * skipping the size-to-order rounding. Freed with `bdalloc_free` like any
+ * other header-carrying block. */
+extern void *bdalloc_order(bdalloc_t *allocator, uint64_t order);
+
+/* bdalloc_alloc_order as a constant expression: for a compile-time-constant
+ * SIZE the max/round/log math folds to a literal. Must stay in sync with
+ * bdalloc_alloc_order. */
+#define BDALLOC_SIZE_ORDER(size)                                               \
+  ((uint64_t)(64 - __builtin_clzll(((uint64_t)(size) < 16                      \
+                                        ? (uint64_t)16                         \
+                                        : (uint64_t)(size)) +                  \
+                                   7)))
+
+/* Fast path for fixed-size allocation sites: BDALLOC_FIXED(a, sizeof(T))
+ * compiles down to a direct freelist pop at the right order. */
+#define BDALLOC_FIXED(allocator, size)                                         \
+  bdalloc_order((allocator), BDALLOC_SIZE_ORDER(size))
+
+/* The order a live block was allocated at, read from its header */
+extern uint64_t bdalloc_block_order(const void *block);
+
+#ifdef BDALLOC_TRACE
+#include <stdio.h>
+
+/* Allocation-event tracing, compiled in only with -DBDALLOC_TRACE (pass
+ * TRACE=1 to make); without it the record sites vanish entirely and the
+ * release hot path is untouched. Each thread registers its own ring, so
+ * recording is a handful of thread-local stores -- no locks, no atomics --
+ * and the ring simply wraps, keeping the most recent events. */
+
+typedef enum bdalloc_trace_op_t {
+  BDALLOC_TRACE_ALLOC = 0,
+  BDALLOC_TRACE_FREE = 1,
+  BDALLOC_TRACE_SPLIT = 2,
+  BDALLOC_TRACE_MERGE = 3,
+} bdalloc_trace_op_t;
+
+typedef struct bdalloc_trace_event_t {
+  uint64_t timestamp; // rdtsc cycles on x86, 0 elsewhere
+  uint32_t op;        // a bdalloc_trace_op_t
+  uint32_t order;
+  void *addr;
+} bdalloc_trace_event_t;
+
+/* Register EVENTS (capacity CAP, a power of two) as the calling thread's
+ * trace ring and reset its cursor. NULL detaches the thread from tracing. */
+extern void bdalloc_set_trace_buffer(bdalloc_trace_event_t *events,
+                                     uint64_t cap);
+
+/* Number of events the calling thread has recorded since registration (may
+ * exceed the ring capacity; only the last CAP are retained). */
+extern uint64_t bdalloc_trace_count(void);
+
+/* Render the calling thread's ring to OUT in collapsed-stack form, one
+ * "bdalloc;<op>;order_<k> <count>" line per distinct event kind -- feed it
+ * straight to flamegraph.pl to see where the operations (and the splits
+ * fragmenting the arena) concentrate. */
+extern void bdalloc_trace_dump(FILE *out);
+#endif
+
 /* Deinitialize the allocator which frees the inner arena */
 extern void bdalloc_deinit(bdalloc_t *allocator);
 
 #ifdef __cplusplus
 }
 #endif
+
+#endif
@@ -0,0 +1,54 @@
+#include <bdalloc.h>
+
+#ifndef _BD_ALLOC_NUMA_H
+#define _BD_ALLOC_NUMA_H 1
+
+#ifdef __linux__
+
+// More nodes than any box we run on
+#define _BD_NUMA_MAX_NODES 8
+
+/* Inform C++, that we are in C land */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One buddy arena per NUMA node. Allocations are routed to the calling
+ * thread's node, so blocks are local to the socket that uses them; frees are
+ * routed back to the owning arena by address range, whichever thread calls
+ * them. The per-node arenas are plain `bdalloc_t`s and may be tuned
+ * individually (growable, lazy coalescing, ...) after init. */
+typedef struct bdalloc_numa_t {
+  bdalloc_t nodes[_BD_NUMA_MAX_NODES];
+  uint64_t node_count;
+} bdalloc_numa_t;
+
+/* Initialize one SIZE-byte arena per node for NODE_COUNT nodes (at most
+ * _BD_NUMA_MAX_NODES). Each arena is mmap'd and bound to its node with
+ * mbind; on kernels without NUMA support the bind is a no-op and first-touch
+ * placement applies. Returns 0 on success, -1 when an arena could not be
+ * acquired. */
+extern int bdalloc_numa_init(bdalloc_numa_t *numa, uint64_t node_count,
+                             uint64_t size);
+
+/* The NUMA node the calling thread is currently running on, clamped to the
+ * configured node count */
+extern uint64_t bdalloc_numa_node(bdalloc_numa_t *numa);
+
+/* Allocate SIZE bytes from the calling thread's node arena */
+extern void *bdalloc_numa(bdalloc_numa_t *numa, uint64_t size);
+
+/* Free a block allocated through `bdalloc_numa` from any thread; it returns
+ * to the arena whose address range contains it */
+extern void bdalloc_numa_free(bdalloc_numa_t *numa, void *block);
+
+/* Release every node arena */
+extern void bdalloc_numa_deinit(bdalloc_numa_t *numa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
+
+#endif
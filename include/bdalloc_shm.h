@@ -0,0 +1,83 @@
+#include <bdalloc.h>
+#include <pthread.h>
+
+#ifndef _BD_ALLOC_SHM_H
+#define _BD_ALLOC_SHM_H 1
+
+/* Inform C++, that we are in C land */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// offset encoding of "no block"; 0 is a valid offset
+#define _BD_SHM_NULL (~0UL)
+
+typedef struct bdalloc_shm_order_t {
+  uint64_t head; // arena-relative offset of the first free block
+  uint64_t count;
+} bdalloc_shm_order_t;
+
+/* The control block at the start of a shared mapping. Everything the buddy
+ * algorithm touches -- freelist heads, pair bitmap, counters, the lock --
+ * lives here, inside the mapping, and every link is an arena-relative
+ * offset. Nothing is a raw pointer, so each process can map the region at
+ * whatever address it lands on. The pair bitmap follows this struct and the
+ * arena follows the bitmap (see bdalloc_shm_footprint). */
+typedef struct bdalloc_shm_header_t {
+  uint64_t magic;
+  uint64_t size;      // arena bytes, a power of two
+  uint64_t arena_off; // arena start, relative to the mapping base
+
+  uint64_t order_mask;
+  uint64_t bytes_in_use;
+  bdalloc_shm_order_t orders[_BD_MAX_MEM_ORDER];
+
+  // PTHREAD_PROCESS_SHARED: one lock for the whole arena. An IPC pool is
+  // bounded by the copy it saves, not by allocator throughput, so the
+  // per-order locking of the in-process allocator would buy nothing here.
+  pthread_mutex_t lock;
+} bdalloc_shm_header_t;
+
+/* A process-local view of a shared arena: just the mapping base decoded into
+ * the pointers this process sees. All shared state is behind `hdr`. */
+typedef struct bdalloc_shm_t {
+  bdalloc_shm_header_t *hdr;
+  uint64_t *pair_bits;
+  void *arena;
+} bdalloc_shm_t;
+
+/* Bytes of shared memory a SIZE-byte arena needs, control block included.
+ * Size the memfd/shm segment with this. */
+extern uint64_t bdalloc_shm_footprint(uint64_t size);
+
+/* Format BASE (a fresh shared mapping of at least bdalloc_shm_footprint(SIZE)
+ * bytes) as a SIZE-byte arena and attach SHM to it. Exactly one process
+ * initializes; everyone else uses bdalloc_attach. Returns this process's
+ * pointer to the arena. */
+extern void *bdalloc_shm_init(bdalloc_shm_t *shm, void *base, uint64_t size);
+
+/* Adopt an arena another process already initialized at BASE (the same
+ * segment, mapped wherever this process got it). Returns the arena as seen
+ * by this process, or NULL if BASE does not hold one. */
+extern void *bdalloc_attach(bdalloc_shm_t *shm, void *base);
+
+/* Allocate SIZE bytes from the shared arena */
+extern void *bdalloc_shm(bdalloc_shm_t *shm, uint64_t size);
+
+/* Free a block allocated by `bdalloc_shm`, from any attached process */
+extern void bdalloc_shm_free(bdalloc_shm_t *shm, void *block);
+
+/* Translate a block to the offset to hand across the IPC boundary, and back
+ * into a pointer in the receiving process's mapping. */
+extern uint64_t bdalloc_shm_offset(bdalloc_shm_t *shm, void *block);
+extern void *bdalloc_shm_block(bdalloc_shm_t *shm, uint64_t offset);
+
+/* Destroy the shared lock. Call from one process, after all have detached;
+ * the mapping's lifetime belongs to the caller. */
+extern void bdalloc_shm_deinit(bdalloc_shm_t *shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
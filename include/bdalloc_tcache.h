@@ -0,0 +1,75 @@
+#include <bdalloc.h>
+#include <pthread.h>
+
+#ifndef _BD_ALLOC_TCACHE_H
+#define _BD_ALLOC_TCACHE_H 1
+
+// Number of cached blocks a thread keeps per order
+#define _BD_TCACHE_MAGAZINE_CAP 8
+
+// Orders above this are never cached; they are large enough that the
+// shared-arena lock is not the dominant cost
+#define _BD_TCACHE_MAX_ORDER 12
+
+/* Inform C++, that we are in C land */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A `bdalloc_t` plus the lock that serializes access to it. Threads never
+ * touch this directly on the hot path; they go through their
+ * `bdalloc_tcache_t` and only fall back here when a magazine runs dry or
+ * overflows. */
+typedef struct bdalloc_shared_t {
+  bdalloc_t *allocator;
+  pthread_mutex_t lock;
+
+  // MPSC remote-free stack: threads without a tcache (or on the wrong side
+  // of a producer/consumer pipeline) push freed blocks here lock-free via
+  // bdalloc_shared_free; they are drained in one batch the next time any
+  // tcache takes the lock. The links live in the dead blocks themselves.
+  void *remote_head;
+} bdalloc_shared_t;
+
+/* Per-thread cache over a shared arena. Each order keeps a small magazine of
+ * ready-to-return blocks so the common alloc/free pair is a couple of array
+ * operations with no locking. */
+typedef struct bdalloc_tcache_t {
+  bdalloc_shared_t *shared;
+
+  uint32_t count[_BD_MAX_MEM_ORDER];
+  void *magazine[_BD_MAX_MEM_ORDER][_BD_TCACHE_MAGAZINE_CAP];
+} bdalloc_tcache_t;
+
+/* Wrap an already-initialized allocator for shared multi-thread use */
+extern void bdalloc_shared_init(bdalloc_shared_t *shared, bdalloc_t *allocator);
+
+/* Destroy the lock. Does not deinit the wrapped allocator */
+extern void bdalloc_shared_deinit(bdalloc_shared_t *shared);
+
+/* Initialize a thread's cache. Each thread owns exactly one */
+extern void bdalloc_tcache_init(bdalloc_tcache_t *tcache,
+                                bdalloc_shared_t *shared);
+
+/* Allocate SIZE bytes, preferring the thread's magazine */
+extern void *bdalloc_tcache(bdalloc_tcache_t *tcache, uint64_t size);
+
+/* Free a block allocated through any tcache of the same shared allocator */
+extern void bdalloc_tcache_free(bdalloc_tcache_t *tcache, void *block);
+
+/* Free a block from a thread that does not own a tcache: one atomic push
+ * onto the remote-free stack, no lock taken and no contention on the
+ * allocator's cache lines. The block is actually returned to the arena the
+ * next time a tcache of this shared allocator locks it (refill, overflow
+ * flush, or a large alloc/free), so remote frees never block the caller. */
+extern void bdalloc_shared_free(bdalloc_shared_t *shared, void *block);
+
+/* Return every cached block to the shared allocator. Must be called before
+ * the owning thread exits */
+extern void bdalloc_tcache_flush(bdalloc_tcache_t *tcache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
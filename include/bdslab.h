@@ -0,0 +1,63 @@
+#include <bdalloc.h>
+
+#ifndef _BD_SLAB_H
+#define _BD_SLAB_H 1
+
+/* Inform C++, that we are in C land */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header at the start of every slab block. The objects follow it. */
+typedef struct bdslab_slab_t {
+  struct bdslab_slab_t *prev;
+  struct bdslab_slab_t *next;
+
+  // intra-slab freelist of previously freed objects
+  void *free_head;
+
+  // live objects, and the next never-used object index
+  uint32_t used;
+  uint32_t bump;
+} bdslab_slab_t;
+
+/* A slab cache for one fixed object size, carved out of buddy blocks.
+ *
+ * Objects pay no power-of-two rounding and no block header: a slab is one
+ * headerless (`bdalloc_sized`) buddy block densely packed with objects, and
+ * alloc/free are O(1) pops and pushes on per-slab freelists with no
+ * split/merge traffic. Use it for small hot objects (e.g. 40-byte message
+ * headers) where the buddy allocator's rounding would double memory use. */
+typedef struct bdslab_t {
+  bdalloc_t *allocator;
+
+  uint64_t obj_size;      // rounded up to an 8-byte multiple
+  uint64_t slab_size;     // power-of-two buddy block per slab
+  uint64_t objs_per_slab;
+
+  // slabs with room, and completely full slabs
+  bdslab_slab_t *partial;
+  bdslab_slab_t *full;
+} bdslab_t;
+
+/* Initialize a slab cache for objects of OBJ_SIZE bytes, backed by the given
+ * allocator. OBJ_SIZE may be anything from 1 byte up to a quarter of the
+ * slab's size; it is rounded up to 8 bytes. */
+extern void bdslab_init(bdslab_t *slab, bdalloc_t *allocator,
+                        uint64_t obj_size);
+
+/* Allocate one object. Returns NULL when the backing allocator is out of
+ * memory. */
+extern void *bdslab_alloc(bdslab_t *slab);
+
+/* Free an object allocated from this slab cache */
+extern void bdslab_free(bdslab_t *slab, void *obj);
+
+/* Return every slab block to the backing allocator, live objects included */
+extern void bdslab_deinit(bdslab_t *slab);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,18 +2,102 @@
 #include <bdalloc.h>
 #include <stdio.h>
 
-// memset
+// memcpy
 #include <string.h>
 
 // malloc
 #include <stdlib.h>
 
+#ifdef __linux__
+// mmap, for the built-in mapped/huge-page arena backing
+#include <sys/mman.h>
+
+// read/write/lseek, for snapshot and restore
+#include <unistd.h>
+#endif
+
+#ifdef BDALLOC_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#ifdef BDALLOC_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 /**
  * A minimum of 16 bytes must be allocated.
  */
 #define _BD_MIN_ALLOC_ORDER 4
 #define _BD_MIN_ALLOC_SIZE (1 << _BD_MIN_ALLOC_ORDER)
 
+#ifdef BDALLOC_TRACE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Each thread records into its own ring: no locks, no shared lines, and a
+// full ring just wraps over the oldest events. The whole mechanism is a
+// bounds-masked store per event, well under the budget printf blew through.
+static __thread bdalloc_trace_event_t *trace_events = NULL;
+static __thread uint64_t trace_cap = 0; // power of two
+static __thread uint64_t trace_head = 0;
+
+static inline uint64_t trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void trace_record(uint32_t op, uint64_t order, void *addr) {
+  if (trace_events == NULL)
+    return;
+
+  bdalloc_trace_event_t *e = &trace_events[trace_head++ & (trace_cap - 1)];
+  e->timestamp = trace_now();
+  e->op = op;
+  e->order = (uint32_t)order;
+  e->addr = addr;
+}
+
+#define _BD_TRACE(op, order, addr) trace_record((op), (order), (addr))
+
+extern void bdalloc_set_trace_buffer(bdalloc_trace_event_t *events,
+                                     uint64_t cap) {
+  // the ring index is a mask, so the capacity must be a power of two
+  // TODO: @ErrorHandling
+  assert(events == NULL || (cap != 0 && (cap & (cap - 1)) == 0));
+
+  trace_events = events;
+  trace_cap = cap;
+  trace_head = 0;
+}
+
+extern uint64_t bdalloc_trace_count(void) { return trace_head; }
+
+extern void bdalloc_trace_dump(FILE *out) {
+  static const char *op_names[] = {"alloc", "free", "split", "merge"};
+
+  // collapse the ring into per-(op, order) counts: flamegraph.pl wants
+  // "frame;frame count" lines, and op;order is the stack that matters here
+  uint64_t counts[4][_BD_MAX_MEM_ORDER] = {{0}};
+  uint64_t retained = trace_head < trace_cap ? trace_head : trace_cap;
+  for (uint64_t i = 0; i < retained; ++i) {
+    const bdalloc_trace_event_t *e = &trace_events[i];
+    if (e->op < 4 && e->order < _BD_MAX_MEM_ORDER)
+      counts[e->op][e->order]++;
+  }
+
+  for (int op = 0; op < 4; ++op)
+    for (int order = 0; order < _BD_MAX_MEM_ORDER; ++order)
+      if (counts[op][order] != 0)
+        fprintf(out, "bdalloc;%s;order_%d %lu\n", op_names[op], order,
+                (unsigned long)counts[op][order]);
+}
+#else
+#define _BD_TRACE(op, order, addr) ((void)0)
+#endif
+
 // remove the head node from the given list, fixing up the prev/next pointers
 static freelist_t *freelist_detach(freelist_t **list) {
   assert(list != NULL);
@@ -40,14 +124,72 @@ static void freelist_splice(freelist_t *node) {
   node->next = NULL;
 }
 
-// attach entry to the front of the list, fixing up the prev/next pointers
+// attach entry right after the head of the list, fixing up the prev/next
+// pointers
 static void freelist_attach(freelist_t *list, freelist_t *entry) {
+  entry->next = list->next;
   if (list->next)
     list->next->prev = entry;
   list->next = entry;
   entry->prev = list;
 }
 
+// push entry onto the list, which may be empty. the entry's own pointers are
+// always rewritten, so callers need not clean them beforehand
+static void freelist_push(freelist_t **list, freelist_t *entry) {
+  if (*list == NULL) {
+    entry->prev = NULL;
+    entry->next = NULL;
+    *list = entry;
+  } else {
+    freelist_attach(*list, entry);
+  }
+}
+
+/**
+ * Per-order locking for the concurrent build.
+ *
+ * When BDALLOC_CONCURRENT is defined, every read or write of
+ * `allocator->orders[order].head` happens inside the order's lock. The code below
+ * is structured so that a detached block is exclusively owned by the calling
+ * thread and can be split or merged without any lock held; only the moment a
+ * block is published to (or taken off) a freelist is serialized, and never
+ * with more than one order locked at a time.
+ */
+#ifdef BDALLOC_CONCURRENT
+#define _BD_ORDER_LOCK(allocator, order)                                       \
+  pthread_mutex_lock(&(allocator)->order_locks[order])
+#define _BD_ORDER_UNLOCK(allocator, order)                                     \
+  pthread_mutex_unlock(&(allocator)->order_locks[order])
+#else
+#define _BD_ORDER_LOCK(allocator, order) ((void)0)
+#define _BD_ORDER_UNLOCK(allocator, order) ((void)0)
+#endif
+
+/**
+ * Shared-word bit updates that cross lock domains.
+ *
+ * order_mask packs every order's occupancy into one word, and adjacent
+ * orders' pair-bit regions share 64-bit words, so holding one order's lock
+ * does not exclude a neighbouring order's read-modify-write of the same
+ * word. In the concurrent build these go through atomic RMWs (relaxed is
+ * enough: the freelists they describe are published under the order locks,
+ * the bits only need to not lose each other's updates).
+ */
+#ifdef BDALLOC_CONCURRENT
+#define _BD_WORD_OR(word, bits) __atomic_fetch_or((word), (bits), __ATOMIC_RELAXED)
+#define _BD_WORD_AND(word, bits)                                               \
+  __atomic_fetch_and((word), (bits), __ATOMIC_RELAXED)
+#define _BD_WORD_XOR(word, bits)                                               \
+  __atomic_fetch_xor((word), (bits), __ATOMIC_RELAXED)
+#define _BD_WORD_LOAD(word) __atomic_load_n((word), __ATOMIC_RELAXED)
+#else
+#define _BD_WORD_OR(word, bits) (*(word) |= (bits))
+#define _BD_WORD_AND(word, bits) (*(word) &= (bits))
+#define _BD_WORD_XOR(word, bits) (*(word) ^= (bits))
+#define _BD_WORD_LOAD(word) (*(word))
+#endif
+
 typedef uint64_t u64;
 typedef int64_t s64;
 
@@ -59,23 +201,63 @@ typedef struct block_header_t {
 /* The allocator currently uses 8 byte per block for header information */
 #define _BD_BLOCK_HEADER_SIZE sizeof(block_header_t)
 
+#ifdef BDALLOC_HARDENED
+// the order lives in the low 8 bits and the in-use flag in bit 63; hardened
+// builds fold a canary over the order into the 55 spare bits in between, and
+// poison up to this many leading bytes of freed blocks
+#define _BD_CANARY_MASK (((1UL << 55) - 1) << 8)
+#define _BD_POISON_BYTES 64UL
+
+// one multiply and a mask: cheap enough to leave on in canary deployments.
+// deliberately address-independent so checkpointed arenas (bdalloc_restore)
+// stay valid when mapped at a different base
+inline u64 header_canary(u64 order) {
+  u64 h = (order + 1) * 0x9E3779B97F4A7C15UL;
+
+  return h & _BD_CANARY_MASK;
+}
+#endif
+
+// the value stamped into a live block's header
+inline u64 header_make(u64 order) {
+  u64 v = order | (1UL << 63);
+#ifdef BDALLOC_HARDENED
+  v |= header_canary(order);
+#endif
+
+  return v;
+}
+
+// the allocation order encoded in a live block's header
+inline u64 header_order(u64 order_and_flags) {
+#ifdef BDALLOC_HARDENED
+  return order_and_flags & 0xFF;
+#else
+  // mask out the MSB, rest of the bits represent the allocation order
+  return order_and_flags & ~(1UL << 63);
+#endif
+}
+
 /**
  * Computes log base two of a perfect power of two integer .
  *
  * The number of trailing zeroes in a number 2^i, is i.
  */
-#define _BD_LOG2I(num) __builtin_ctz(num)
+#define _BD_LOG2I(num) __builtin_ctzll(num)
 
 /**
  * Given a block of size 2^order, located at 'addr', returns the sibling
  * of this block (also of same size).
  *
  * Because of the way we allocate, siblings are powers of two away from
- * each other, which means flipping the 'order' bit of the address
- * of one, provides the address of the other.
+ * each other, which means flipping the 'order' bit of the offset
+ * of one within the arena, provides the offset of the other. The offset
+ * must be used here (not the raw address) since the arena base itself is
+ * not guaranteed to be aligned to the block size.
  */
-inline freelist_t *get_sibling_addr(void *addr, int order) {
-  void *sibling_addr = (void *)((u64)addr ^ (1 << order));
+inline freelist_t *get_sibling_addr(void *base, void *addr, int order) {
+  u64 offset = (u64)addr - (u64)base;
+  void *sibling_addr = (void *)((char *)base + (offset ^ (1UL << order)));
 
   freelist_t *sibling = (freelist_t *)(sibling_addr);
 
@@ -88,7 +270,7 @@ inline u64 min(u64 a, u64 b) { return a < b ? a : b; }
 /**
  * A branchless routine to compute the next power of two for 'value'
  *
- * Copied from Hacker's Delight, Figure 3-3.
+ * Copied from Hacker's Delight, Figure 3-3, widened to 64 bits.
  */
 inline u64 next_power_of_two(u64 x) {
   x--;
@@ -98,48 +280,499 @@ inline u64 next_power_of_two(u64 x) {
   x |= x >> 4;
   x |= x >> 8;
   x |= x >> 16;
+  x |= x >> 32;
 
   return ++x;
 }
 
-inline void create_freelist(void *block) {
-  freelist_t node = {NULL, NULL};
-  memcpy(block, &node, sizeof(node));
+// the order spanning the whole arena; blocks of this order have no buddy
+inline u64 arena_order(bdalloc_t *allocator) {
+  return _BD_LOG2I(allocator->size);
 }
 
 /**
- * Initializes the allocator.
+ * Out-of-band buddy state bitmap.
+ *
+ * For every buddy pair at every order below the arena's top order we keep a
+ * single bit: the XOR of "is on this order's freelist" across the two
+ * siblings. The bit is toggled whenever either sibling is attached to or
+ * detached from that order's freelist. A thread freeing a block (which is
+ * itself detached) can then read one hot bitmap bit to learn whether the
+ * buddy is free at the same order: no probing of the buddy's cold header
+ * line, and no ambiguity when the buddy has been split into smaller in-use
+ * pieces (those are tracked at a different order).
+ *
+ * Bits are laid out per order, smallest order first. Orders below
+ * _BD_MIN_ALLOC_ORDER never hold blocks, so the region for order o starts at
+ * bit (size >> _BD_MIN_ALLOC_ORDER) - (size >> o), the closed form of the sum
+ * of the preceding region sizes.
  */
-extern void *bdalloc_init(bdalloc_t *allocator, u64 size) {
-  size = next_power_of_two(size + _BD_BLOCK_HEADER_SIZE);
+inline u64 pair_bit_index(bdalloc_t *allocator, void *block, u64 order) {
+  u64 offset = (u64)block - (u64)allocator->arena;
+  u64 region =
+      (allocator->size >> _BD_MIN_ALLOC_ORDER) - (allocator->size >> order);
+
+  return region + (offset >> (order + 1));
+}
+
+inline void pair_bit_toggle(bdalloc_t *allocator, void *block, u64 order) {
+  u64 idx = pair_bit_index(allocator, block, order);
+  _BD_WORD_XOR(&allocator->pair_bits[idx >> 6], 1UL << (idx & 63));
+}
+
+inline int pair_bit_get(bdalloc_t *allocator, void *block, u64 order) {
+  u64 idx = pair_bit_index(allocator, block, order);
+
+  return (_BD_WORD_LOAD(&allocator->pair_bits[idx >> 6]) >> (idx & 63)) & 0x1;
+}
+
+#ifdef __linux__
+/**
+ * Decommit tracking for bdalloc_trim.
+ *
+ * One bit per arena page, set while the free block starting at that page has
+ * had its interior advised away. The block's first page holds its freelist
+ * node and stays resident, so it is the natural key. The bit is dropped the
+ * moment the block leaves its freelist -- taken for an allocation, split, or
+ * absorbed by a merge -- which is what lets a repeat trim pass skip blocks
+ * whose state has not changed since the last one.
+ */
+
+// below this order a block has no full page beyond the node page to give back
+#define _BD_TRIM_MIN_ORDER 13
+
+inline u64 trim_bit_words(u64 size) {
+  return max(((size >> 12) + 63) >> 6, 1);
+}
+
+inline int trim_bit_get(bdalloc_t *allocator, void *block) {
+  u64 page = ((u64)block - (u64)allocator->arena) >> 12;
+
+  return (_BD_WORD_LOAD(&allocator->trim_bits[page >> 6]) >> (page & 63)) & 0x1;
+}
+
+inline void trim_bit_set(bdalloc_t *allocator, void *block) {
+  u64 page = ((u64)block - (u64)allocator->arena) >> 12;
+  _BD_WORD_OR(&allocator->trim_bits[page >> 6], 1UL << (page & 63));
+}
+
+// called whenever a block leaves its freelist; rolls back the decommit
+// accounting if the block had been trimmed
+inline void trim_mark_resident(bdalloc_t *allocator, void *block, u64 order) {
+  if (order < _BD_TRIM_MIN_ORDER)
+    return;
+
+  u64 page = ((u64)block - (u64)allocator->arena) >> 12;
+  u64 bit = 1UL << (page & 63);
+#ifdef BDALLOC_CONCURRENT
+  u64 prev =
+      __atomic_fetch_and(&allocator->trim_bits[page >> 6], ~bit, __ATOMIC_RELAXED);
+#else
+  u64 prev = allocator->trim_bits[page >> 6];
+  allocator->trim_bits[page >> 6] &= ~bit;
+#endif
+  if (prev & bit)
+    allocator->trimmed_bytes -= (1UL << order) - 4096;
+}
+#endif /* __linux__ */
+
+/**
+ * Whole-bitmap popcount, the one pair-bitmap operation that is a real scan:
+ * point queries go through pair_bit_get and "is there a block of order k"
+ * through order_mask, both O(1), but counting every set bit walks the full
+ * bitmap -- 4MB of bits for a 4GB arena. Build with SIMD=avx2 (or SIMD=neon)
+ * to vectorize it; the default is a scalar popcount loop, which the arena
+ * sizes in the tests never notice.
+ */
+static u64 bitmap_popcount(const uint64_t *words, u64 nwords) {
+  u64 total = 0;
+  u64 i = 0;
+
+#ifdef BDALLOC_SIMD_AVX2
+  // AVX2 has no vector popcount, so count per-nibble via a shuffled lookup
+  // table and horizontally sum the bytes with a sad against zero. The sad
+  // runs every iteration, so the byte counters cannot saturate.
+  const __m256i lut =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                       1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 4 <= nwords; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(words + i));
+    __m256i lo = _mm256_and_si256(v, low_nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                    _mm256_shuffle_epi8(lut, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+  total += (u64)_mm256_extract_epi64(acc, 0) +
+           (u64)_mm256_extract_epi64(acc, 1) +
+           (u64)_mm256_extract_epi64(acc, 2) +
+           (u64)_mm256_extract_epi64(acc, 3);
+#endif
+
+#ifdef BDALLOC_SIMD_NEON
+  // NEON counts bits per byte directly; widen pairwise up to two 64-bit
+  // lanes per iteration
+  uint64x2_t acc = vdupq_n_u64(0);
+  for (; i + 2 <= nwords; i += 2) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(words + i));
+    acc = vaddq_u64(acc, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vcntq_u8(v)))));
+  }
+  total += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+  // scalar fallback, and the tail the vector loops leave behind
+  for (; i < nwords; ++i)
+    total += (u64)__builtin_popcountll(words[i]);
+
+  return total;
+}
+
+// Attach/detach on an order's freelist, keeping the buddy state bitmap in
+// sync. All freelist traffic on orders[] must go through these.
+static void blocks_attach(bdalloc_t *allocator, u64 order, freelist_t *entry) {
+  freelist_push(&allocator->orders[order].head, entry);
+  allocator->orders[order].count++;
+  _BD_WORD_OR(&allocator->order_mask, 1UL << order);
+  if (order < arena_order(allocator))
+    pair_bit_toggle(allocator, entry, order);
+}
+
+static freelist_t *blocks_detach(bdalloc_t *allocator, u64 order) {
+  freelist_t *head = freelist_detach(&allocator->orders[order].head);
+  allocator->orders[order].count--;
+  if (allocator->orders[order].head == NULL)
+    _BD_WORD_AND(&allocator->order_mask, ~(1UL << order));
+  if (order < arena_order(allocator))
+    pair_bit_toggle(allocator, head, order);
+#ifdef __linux__
+  trim_mark_resident(allocator, head, order);
+#endif
+
+  return head;
+}
+
+/**
+ * Sets up freelists, the pair bitmap and locks for an allocator whose arena
+ * and backing fields are already in place. SIZE must be a power of two.
+ */
+static void *arena_bookkeeping(bdalloc_t *allocator, u64 size) {
   u64 order = _BD_LOG2I(size);
 
   // Cannot initialize blocks too small
   // TODO: @ErrorHandling
   assert(size >= (1 << _BD_MIN_ALLOC_ORDER));
 
-  // TODO: @CustomArenas
-  allocator->arena = malloc(size);
-  if (allocator->arena == NULL)
-    return NULL;
   allocator->size = size;
 
-  // zero it out. this is necessary because we embed block free/used states as a
-  // header
-  memset(allocator->arena, 0, size);
+  // one bit per buddy pair per order; all-zero matches "no block on any
+  // freelist below the top order"
+  u64 pair_bit_words = ((size >> _BD_MIN_ALLOC_ORDER) + 63) >> 6;
+  allocator->pair_bits = (uint64_t *)calloc(pair_bit_words, sizeof(uint64_t));
+  if (allocator->pair_bits == NULL)
+    return NULL;
+
+  // The arena itself is deliberately left untouched: block state lives in
+  // the out-of-band bitmap and freelist pushes rewrite a node's link words,
+  // so no headers need pre-clearing. Besides making init O(1) in the arena
+  // size, this keeps mmap-backed arenas lazily faulted until first use.
 
   // The blocks are empty, except the first - which points the entire arena
   for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
-    allocator->blocks[i] = NULL;
+    allocator->orders[i].head = NULL;
+    allocator->orders[i].count = 0;
+    allocator->reserve[i].head = NULL;
+    allocator->reserve[i].count = 0;
+    allocator->reserve_target[i] = 0;
+  }
+  allocator->order_mask = 0;
+  allocator->lazy_watermark = 0;
+  allocator->max_merge_levels = 0;
+  allocator->trim_watermark = 0;
+  allocator->bytes_in_use = 0;
+  allocator->peak_in_use = 0;
+  allocator->split_count = 0;
+  allocator->coalesce_count = 0;
+  allocator->next_arena = NULL;
+  allocator->growable = 0;
+  allocator->epoch = NULL;
+  allocator->bump_cur = NULL;
+  allocator->bump_end = NULL;
+#ifdef __linux__
+  for (int i = 0; i < _BD_LARGE_BUCKETS; ++i)
+    allocator->large[i] = NULL;
+  allocator->large_bytes = 0;
+
+  // all-zero matches "nothing decommitted"
+  allocator->trim_bits =
+      (uint64_t *)calloc(trim_bit_words(size), sizeof(uint64_t));
+  if (allocator->trim_bits == NULL) {
+    free(allocator->pair_bits);
+    return NULL;
+  }
+  allocator->trimmed_bytes = 0;
+#endif
+
+  // The arena itself must also behave as a freelist_t; attaching it sets up
+  // its list pointers
+  blocks_attach(allocator, order, (freelist_t *)allocator->arena);
+
+#ifdef BDALLOC_CONCURRENT
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    pthread_mutex_init(&allocator->order_locks[i], NULL);
   }
-  allocator->blocks[order] = (freelist_t *)allocator->arena;
+  pthread_mutex_init(&allocator->grow_lock, NULL);
+#endif
+
+  return allocator->arena;
+}
+
+/**
+ * Initializes one allocator with an arena of exactly SIZE (a power of two)
+ * bytes, acquired through the given backing callbacks (malloc/free when
+ * NULL). Shared by the init variants and the chain-growing path.
+ */
+static void *arena_init(bdalloc_t *allocator, u64 size, bdalloc_map_fn map,
+                        bdalloc_unmap_fn unmap, void *user) {
+  allocator->map = map;
+  allocator->unmap = unmap;
+  allocator->map_user = user;
+  allocator->foreign_arena = 0;
+
+  // page-align malloc-backed arenas: blocks are size-aligned relative to the
+  // arena base, so this is what lets bdalloc_aligned promise absolute
+  // alignments (up to a page) without over-allocating
+  allocator->arena =
+      map != NULL ? map(size, user) : aligned_alloc(min(size, 4096), size);
+  if (allocator->arena == NULL)
+    return NULL;
 
-  // The arena itself must also behave as a freelist_t
-  create_freelist(allocator->arena);
+  if (arena_bookkeeping(allocator, size) == NULL) {
+    if (unmap != NULL)
+      unmap(allocator->arena, size, user);
+    else
+      free(allocator->arena);
+    return NULL;
+  }
 
   return allocator->arena;
 }
 
+/**
+ * Initializes the allocator.
+ */
+extern void *bdalloc_init(bdalloc_t *allocator, u64 size) {
+  size = next_power_of_two(size + _BD_BLOCK_HEADER_SIZE);
+
+  return arena_init(allocator, size, NULL, NULL, NULL);
+}
+
+/* Initialize with a caller-supplied backing, e.g. mmap'd or shm memory */
+extern void *bdalloc_init_backed(bdalloc_t *allocator, u64 size,
+                                 bdalloc_map_fn map, bdalloc_unmap_fn unmap,
+                                 void *user) {
+  size = next_power_of_two(size + _BD_BLOCK_HEADER_SIZE);
+
+  return arena_init(allocator, size, map, unmap, user);
+}
+
+/* Adopt caller-provided memory as the arena; its lifetime stays with the
+ * caller */
+extern void *bdalloc_init_arena(bdalloc_t *allocator, void *mem, u64 size) {
+  // the arena must be a power of two
+  assert(next_power_of_two(size) == size);
+
+  allocator->map = NULL;
+  allocator->unmap = NULL;
+  allocator->map_user = NULL;
+  allocator->foreign_arena = 1;
+  allocator->arena = mem;
+
+  return arena_bookkeeping(allocator, size);
+}
+
+#ifdef __linux__
+// Built-in mmap backing. A non-NULL user pointer requests MAP_HUGETLB,
+// falling back to normal pages when the system has no huge pages reserved.
+static void *bd_mmap_map(u64 size, void *user) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  if (user != NULL) {
+    void *mem =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+      return mem;
+  }
+
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+static void bd_mmap_unmap(void *addr, u64 size, void *user) {
+  (void)user;
+  munmap(addr, size);
+}
+
+extern void *bdalloc_init_mmap(bdalloc_t *allocator, u64 size, int huge) {
+  return bdalloc_init_backed(allocator, size, bd_mmap_map, bd_mmap_unmap,
+                             huge ? (void *)1 : NULL);
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Large-allocation passthrough.
+ *
+ * A request above the top order of every arena in the chain used to mean a
+ * second allocator and two code paths in the caller. Instead it goes
+ * straight to its own mmap, rounded to pages rather than the next power of
+ * two (a 6GB scratch buffer must not cost 8GB), and is recorded in a small
+ * registry hashed by address so bdalloc_free can route it to munmap. The
+ * buckets are almost always empty, so the free-path probe is one load.
+ */
+
+typedef struct bdalloc_large_t {
+  struct bdalloc_large_t *next;
+  void *addr;
+  u64 size; // page-rounded mapping size
+} bdalloc_large_t;
+
+// mappings are page-aligned, so the page number is the natural key
+inline u64 large_hash(void *addr) {
+  return ((u64)addr >> 12) & (_BD_LARGE_BUCKETS - 1);
+}
+
+static void *large_alloc(bdalloc_t *allocator, u64 size) {
+  u64 mapped = (size + 4095) & ~4095UL;
+
+  void *mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return NULL;
+
+  bdalloc_large_t *entry = (bdalloc_large_t *)malloc(sizeof(bdalloc_large_t));
+  if (entry == NULL) {
+    munmap(mem, mapped);
+    return NULL;
+  }
+  entry->addr = mem;
+  entry->size = mapped;
+
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_lock(&allocator->grow_lock);
+#endif
+  u64 h = large_hash(mem);
+  entry->next = allocator->large[h];
+  allocator->large[h] = entry;
+  allocator->large_bytes += mapped;
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_unlock(&allocator->grow_lock);
+#endif
+
+  return mem;
+}
+
+// Unmaps BLK if the registry owns it; returns whether it did
+static int large_free(bdalloc_t *allocator, void *blk) {
+  u64 h = large_hash(blk);
+  if (allocator->large[h] == NULL)
+    return 0;
+
+  bdalloc_large_t *entry = NULL;
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_lock(&allocator->grow_lock);
+#endif
+  for (bdalloc_large_t **link = &allocator->large[h]; *link != NULL;
+       link = &(*link)->next) {
+    if ((*link)->addr == blk) {
+      entry = *link;
+      *link = entry->next;
+      allocator->large_bytes -= entry->size;
+      break;
+    }
+  }
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_unlock(&allocator->grow_lock);
+#endif
+
+  if (entry == NULL)
+    return 0;
+
+  munmap(entry->addr, entry->size);
+  free(entry);
+
+  return 1;
+}
+
+/**
+ * Resizes BLK at the mapping level if the registry owns it; returns whether
+ * it did, with the (possibly moved) mapping in *OUT. mremap grows or shrinks
+ * in place when the neighbouring pages allow it and moves the pages
+ * otherwise, so unlike the copying fallback in bdalloc_realloc no data is
+ * ever copied. A shrunk mapping stays in the registry even when the new size
+ * would fit the arena: pulling it back in would force the copy the caller is
+ * trying to avoid.
+ */
+static int large_realloc(bdalloc_t *allocator, void *blk, u64 new_size,
+                         void **out) {
+  u64 h = large_hash(blk);
+  if (allocator->large[h] == NULL)
+    return 0;
+
+  u64 mapped = (new_size + 4095) & ~4095UL;
+
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_lock(&allocator->grow_lock);
+#endif
+  bdalloc_large_t *entry = NULL;
+  for (bdalloc_large_t **link = &allocator->large[h]; *link != NULL;
+       link = &(*link)->next) {
+    if ((*link)->addr == blk) {
+      entry = *link;
+      if (mapped != entry->size)
+        *link = entry->next; // moving may rebucket; unlink up front
+      break;
+    }
+  }
+
+  int handled = 0;
+  if (entry != NULL) {
+    handled = 1;
+    if (mapped == entry->size) {
+      *out = blk;
+    } else {
+      void *mem = mremap(entry->addr, entry->size, mapped, MREMAP_MAYMOVE);
+      if (mem == MAP_FAILED) {
+        // put the untouched mapping back; the caller sees plain failure
+        entry->next = allocator->large[h];
+        allocator->large[h] = entry;
+        *out = NULL;
+      } else {
+        allocator->large_bytes -= entry->size;
+        allocator->large_bytes += mapped;
+        entry->addr = mem;
+        entry->size = mapped;
+        u64 nh = large_hash(mem);
+        entry->next = allocator->large[nh];
+        allocator->large[nh] = entry;
+        *out = mem;
+      }
+    }
+  }
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_unlock(&allocator->grow_lock);
+#endif
+
+  return handled;
+}
+#endif /* __linux__ */
+
+extern void bdalloc_set_growable(bdalloc_t *allocator, int growable) {
+  allocator->growable = growable;
+}
+
 /**
  * Transforms a block of memory that we are currently threading the freelist
  * through, into a block that the user can use.
@@ -155,181 +788,1355 @@ extern void *bdalloc_init(bdalloc_t *allocator, u64 size) {
 inline void *freelist_to_user_blk(freelist_t *block, u64 alloc_order) {
   block_header_t *mem = (block_header_t *)block;
 
-  u64 order_and_flags = alloc_order | (1UL << 63);
-  mem->order_and_flags = order_and_flags;
+  mem->order_and_flags = header_make(alloc_order);
 
   void *user_mem = (void *)(mem + 1);
 
   return user_mem;
 }
 
-/* Deinitializes the allocator */
-extern void bdalloc_deinit(bdalloc_t *allocator) {
-  // TODO: @CustomArenas
-  free(allocator->arena);
-}
-
-/* Allocate SIZE bytes */
-extern void *bdalloc(bdalloc_t *allocator, u64 size) {
-  // Find out the size (and corresponding order) we are going to allocate.
+/* The order a request for SIZE bytes will be rounded up to. Kept in sync with
+ * the rounding done at the top of `bdalloc` so callers (e.g. the tcache
+ * layer) can bucket requests the same way the allocator does. */
+extern u64 bdalloc_alloc_order(u64 size) {
   u64 alloc_size = max(size, _BD_MIN_ALLOC_SIZE);
   alloc_size = next_power_of_two(alloc_size + _BD_BLOCK_HEADER_SIZE);
-  u64 alloc_order = _BD_LOG2I(alloc_size);
-
-  // Check if a block of alloc_order is already available. If it is,
-  // then simply detach that block, add the header, and return it
-  // to the user.
-  {
-    freelist_t **alloc_blocks = &allocator->blocks[alloc_order];
-    if (*alloc_blocks != NULL) {
-      freelist_t *block = freelist_detach(alloc_blocks);
-      assert(block != NULL);
-      void *mem = freelist_to_user_blk(block, alloc_order);
 
-      return mem;
-    }
-  }
+  return _BD_LOG2I(alloc_size);
+}
 
-  // try finding a bigger available block
-  u64 available_order = alloc_order;
-  {
-    freelist_t **block = &allocator->blocks[available_order];
-    for (; available_order < _BD_MAX_MEM_ORDER && *block == NULL;
-         available_order++) {
-      block = &allocator->blocks[available_order];
-    }
+/* The order a live block was allocated at, read from its header */
+extern u64 bdalloc_block_order(const void *block) {
+  const block_header_t *mem = (const block_header_t *)block;
+  mem--; // unwind to reveal header
 
-    // if no block found, either out of memory, or too fragmented.
-    if (*block == NULL) {
-      return NULL;
-    }
+  return header_order(mem->order_and_flags);
+}
 
-    // the loop results in an off by one value
-    available_order--;
-  }
-
-  // Break up larger order blocks into blocks of alloc_order. This
-  // works by splitting up blocks into two equal halves, then splitting the
-  // first half again, and again until the desired block is created.
-  {
-    for (u64 order = available_order; order > alloc_order; order--) {
-      // first child starts at the same address as parent.
-      freelist_t *first = freelist_detach(&allocator->blocks[order]);
-
-      // sibling initially has no pointers until it is attached to the freelist
-      // at the smaller order
-      freelist_t *second = get_sibling_addr(first, order - 1);
-      second->prev = NULL;
-      second->next = NULL;
-
-      // child is 1 level lower
-      freelist_t **children = &allocator->blocks[order - 1];
-      if (*children == NULL) {
-        *children = first;
-        freelist_attach(*children, second);
-      } else {
-        freelist_attach(*children, first);
-        freelist_attach(*children, second);
-      }
+// Releases one allocator's arena and bookkeeping
+static void arena_deinit(bdalloc_t *allocator) {
+#ifdef BDALLOC_CONCURRENT
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    pthread_mutex_destroy(&allocator->order_locks[i]);
+  }
+  pthread_mutex_destroy(&allocator->grow_lock);
+#endif
+
+  bdalloc_epoch_end(allocator);
+
+#ifdef __linux__
+  // passthrough mappings still registered are leaked allocations; reclaim
+  // them with the arena
+  for (int i = 0; i < _BD_LARGE_BUCKETS; ++i) {
+    while (allocator->large[i] != NULL) {
+      bdalloc_large_t *entry = allocator->large[i];
+      allocator->large[i] = entry->next;
+      munmap(entry->addr, entry->size);
+      free(entry);
     }
   }
+#endif
+
+  if (allocator->unmap != NULL)
+    allocator->unmap(allocator->arena, allocator->size, allocator->map_user);
+  else if (!allocator->foreign_arena)
+    free(allocator->arena);
+  free(allocator->pair_bits);
+#ifdef __linux__
+  free(allocator->trim_bits);
+#endif
+}
 
-  // An entry must exist for this allocation order at this point.
-  assert(allocator->blocks[alloc_order] != NULL);
-
-  // Detach the entry, and write the headers
-  freelist_t *mem_block = freelist_detach(&allocator->blocks[alloc_order]);
-  void *mem = freelist_to_user_blk(mem_block, alloc_order);
+/* Deinitializes the allocator, including any arenas acquired by growing */
+extern void bdalloc_deinit(bdalloc_t *allocator) {
+  bdalloc_t *next = allocator->next_arena;
+  while (next != NULL) {
+    bdalloc_t *after = next->next_arena;
+    arena_deinit(next);
+    free(next);
+    next = after;
+  }
 
-  return mem;
+  arena_deinit(allocator);
 }
 
 /**
- * Given a pointer to a block that is being deallocated, unwinds the pointer
- * to reveal the header and returns the allocation order.
- *
- * After this method, *block can be threaded back onto the freelist.
+ * Appends a fresh arena to the chain, at least double the size of the last
+ * one (and big enough for alloc_order). Returns the new allocator, or NULL
+ * when the system is out of memory or the request can never fit.
  */
-inline u64 prepare_for_free(void **block) {
-  block_header_t *mem = (block_header_t *)(*block);
-  mem--; // unwind to reveal header
+static bdalloc_t *grow_chain(bdalloc_t *allocator, u64 alloc_order) {
+  if (alloc_order >= _BD_MAX_MEM_ORDER)
+    return NULL;
 
-  // mask out the MSB, rest of the bits represent the allocation order
-  u64 mask = ~(1UL << 63);
-  u64 order = (mem->order_and_flags) & mask;
+  bdalloc_t *last = allocator;
+  while (last->next_arena != NULL)
+    last = last->next_arena;
 
-  // point to the real block (where the header starts)
-  *block = (void *)mem;
+  u64 new_size = max(last->size << 1, 1UL << alloc_order);
+  if (new_size > (1UL << (_BD_MAX_MEM_ORDER - 1)))
+    new_size = 1UL << (_BD_MAX_MEM_ORDER - 1);
+  if (new_size < (1UL << alloc_order))
+    return NULL;
 
-  // clean up the data to make it castable to freelist
-  create_freelist(*block);
+  bdalloc_t *next = (bdalloc_t *)malloc(sizeof(bdalloc_t));
+  if (next == NULL)
+    return NULL;
+  // grown arenas share the root's backing callbacks
+  if (arena_init(next, new_size, allocator->map, allocator->unmap,
+                 allocator->map_user) == NULL) {
+    free(next);
+    return NULL;
+  }
+  next->lazy_watermark = allocator->lazy_watermark;
+  next->max_merge_levels = allocator->max_merge_levels;
+  next->trim_watermark = allocator->trim_watermark;
 
-  return order;
+  last->next_arena = next;
+
+  return next;
 }
 
-// Removes 'block' from the allocator's allocation list 'alloc_list' assuming
-// the block does exist in that list.
-inline void bdalloc_splice_block(freelist_t **alloc_list, freelist_t *block) {
-  // remove the block from the list, fixing up neighboring pointers
-  freelist_splice(block);
+// the arena in the chain whose address range contains ptr
+static bdalloc_t *owning_arena(bdalloc_t *allocator, void *ptr) {
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    u64 offset = (u64)ptr - (u64)a->arena;
+    if (offset < a->size)
+      return a;
+  }
 
-  // if it was the first block in the alloc list, fixup the head of the list by
-  // by detaching the current head (i.e. detaching 'block')
-  if (*alloc_list == block)
-    freelist_detach(alloc_list);
+  return NULL;
 }
 
-// Recursively colaesces a block of a given order with it's buddy, provided that
-// the buddy is free.
-void coalesce_at_order(bdalloc_t *allocator, freelist_t *block, u64 order,
-                       u64 max_order) {
-  if (order == max_order)
-    return;
+extern bdalloc_t *bdalloc_owning_arena(bdalloc_t *allocator, void *ptr) {
+  return owning_arena(allocator, ptr);
+}
 
-  freelist_t *bud = get_sibling_addr(block, order);
+/**
+ * Takes ownership of a block of exactly alloc_order, preferring an exact fit
+ * and splitting a larger block otherwise. Returns NULL when out of memory or
+ * too fragmented.
+ *
+ * A detached block is invisible to other threads, so nothing stays locked
+ * across the split loop: each split publishes only the second half to the
+ * freelist one level lower and keeps splitting the still-owned first half,
+ * again and again until the desired block is created.
+ */
+static void coalesce_order_pass(bdalloc_t *allocator, u64 order);
+
+#ifdef __linux__
+extern u64 bdalloc_trim(bdalloc_t *allocator, u64 target_bytes);
+#endif
+
+static freelist_t *search_and_detach(bdalloc_t *allocator, u64 alloc_order,
+                                     u64 *found_order) {
+  // The smallest sufficient non-empty order is a find-first-set over the
+  // occupancy mask, not a walk over orders[]. In the concurrent build a bit
+  // can go stale between the mask read and taking the lock, so orders that
+  // turn out empty are dropped from consideration and the mask re-read.
+  u64 tried = 0;
+  u64 mask;
+  while ((mask = (_BD_WORD_LOAD(&allocator->order_mask) >> alloc_order) &
+                 ~tried) != 0) {
+    u64 bit = mask & -mask;
+    u64 order = alloc_order + _BD_LOG2I(bit);
+
+    _BD_ORDER_LOCK(allocator, order);
+    if (allocator->orders[order].head != NULL) {
+      freelist_t *block = blocks_detach(allocator, order);
+      _BD_ORDER_UNLOCK(allocator, order);
+      *found_order = order;
+
+      return block;
+    }
+    _BD_ORDER_UNLOCK(allocator, order);
 
-  block_header_t *bud_header = (block_header_t *)bud;
-  int is_bud_in_use = (bud_header->order_and_flags >> 63UL) & 0x1;
-  if (is_bud_in_use)
-    return;
+    tried |= bit;
+  }
+
+  return NULL;
+}
 
-  // splice off the block & it's buddy from their allocation lists (they belong
-  // to the same one)
-  bdalloc_splice_block(&allocator->blocks[order], block);
-  bdalloc_splice_block(&allocator->blocks[order], bud);
+static freelist_t *take_block(bdalloc_t *allocator, u64 alloc_order) {
+  u64 order = alloc_order;
+  freelist_t *block = search_and_detach(allocator, alloc_order, &order);
+
+  // Under lazy coalescing or bounded merging a failed search may just mean
+  // the free memory is sitting unmerged on the lower freelists: merge
+  // everything and retry once.
+  if (block == NULL &&
+      (allocator->lazy_watermark != 0 || allocator->max_merge_levels != 0)) {
+    for (u64 o = _BD_MIN_ALLOC_ORDER; o < arena_order(allocator); ++o) {
+      coalesce_order_pass(allocator, o);
+    }
+    block = search_and_detach(allocator, alloc_order, &order);
+  }
 
-  // take the smaller of the two addresses, as the smaller address will
-  // be the address for the combined block
-  freelist_t *next = block;
-  if (min((u64)block, (u64)bud) == (u64)bud)
-    next = bud;
+  if (block == NULL)
+    return NULL;
 
-  // attach the combined block to the freelist of order+1
-  freelist_t **list = &allocator->blocks[order + 1];
-  if (*list == NULL) {
-    *list = next;
-  } else {
-    freelist_attach(*list, next);
+  while (order > alloc_order) {
+    order--;
+    allocator->split_count++;
+    _BD_TRACE(BDALLOC_TRACE_SPLIT, order, block);
+
+    freelist_t *second = get_sibling_addr(allocator->arena, block, order);
+
+    // the two cold lines the attach dereferences are the freshly split half
+    // (its list words get written) and the current head (its prev pointer);
+    // start both loads before taking the lock so the surgery doesn't stall
+    // on a dependent miss per level
+    __builtin_prefetch(second, 1);
+    __builtin_prefetch(allocator->orders[order].head, 1);
+
+    _BD_ORDER_LOCK(allocator, order);
+    blocks_attach(allocator, order, second);
+    _BD_ORDER_UNLOCK(allocator, order);
   }
 
-  // recursively coalesce
-  coalesce_at_order(allocator, next, order + 1, max_order);
+  allocator->bytes_in_use += 1UL << alloc_order;
+  if (allocator->bytes_in_use > allocator->peak_in_use)
+    allocator->peak_in_use = allocator->bytes_in_use;
+
+  return block;
 }
 
-/* Free a block allocated by `bdalloc`. This only returns the block to the
- * allocator, not necessarily to the system. */
-extern void bdalloc_free(bdalloc_t *allocator, void *blk) {
-  u64 order = prepare_for_free(&blk);
-  freelist_t *freed_blk = (freelist_t *)blk;
+/**
+ * take_block across the whole arena chain, growing it as a last resort when
+ * the allocator is growable.
+ */
+static freelist_t *chain_take_block(bdalloc_t *allocator, u64 alloc_order) {
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    freelist_t *block = take_block(a, alloc_order);
+    if (block != NULL)
+      return block;
+  }
 
-  freelist_t **list = &allocator->blocks[order];
-  if (*list == NULL) {
-    *list = freed_blk;
-  } else {
-    freelist_attach(*list, freed_blk);
+  if (!allocator->growable)
+    return NULL;
+
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_lock(&allocator->grow_lock);
+  // another thread may have grown the chain while we waited
+  freelist_t *raced = NULL;
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    raced = take_block(a, alloc_order);
+    if (raced != NULL)
+      break;
+  }
+  if (raced != NULL) {
+    pthread_mutex_unlock(&allocator->grow_lock);
+    return raced;
   }
+#endif
+
+  bdalloc_t *next = grow_chain(allocator, alloc_order);
+
+#ifdef BDALLOC_CONCURRENT
+  pthread_mutex_unlock(&allocator->grow_lock);
+#endif
+
+  if (next == NULL)
+    return NULL;
+
+  return take_block(next, alloc_order);
+}
+
+/**
+ * Reserved pools (see bdalloc_reserve): blocks pinned per order, outside the
+ * buddy machinery entirely. They were detached by take_block when the
+ * reservation was made, so the pair bitmap considers them allocated and no
+ * merge or sweep can ever absorb one; popping and refilling is plain
+ * freelist surgery with none of the blocks_* bookkeeping, which is what
+ * makes both ends O(1).
+ */
+static freelist_t *reserve_take(bdalloc_t *allocator, u64 order) {
+  // requests beyond the top order reach here on platforms without the mmap
+  // passthrough; they have no pool (or pool slot) to consult
+  if (order >= _BD_MAX_MEM_ORDER || allocator->reserve[order].head == NULL)
+    return NULL;
+
+  _BD_ORDER_LOCK(allocator, order);
+  freelist_t *block = NULL;
+  if (allocator->reserve[order].head != NULL) {
+    block = freelist_detach(&allocator->reserve[order].head);
+    allocator->reserve[order].count--;
+  }
+  _BD_ORDER_UNLOCK(allocator, order);
+
+  return block;
+}
+
+static int reserve_put(bdalloc_t *allocator, freelist_t *block, u64 order) {
+  if (allocator->reserve_target[order] == 0)
+    return 0;
+
+  int kept = 0;
+  _BD_ORDER_LOCK(allocator, order);
+  if (allocator->reserve[order].count < allocator->reserve_target[order]) {
+    freelist_push(&allocator->reserve[order].head, block);
+    allocator->reserve[order].count++;
+    kept = 1;
+  }
+  _BD_ORDER_UNLOCK(allocator, order);
+
+  return kept;
+}
+
+/**
+ * Bump region (see bdalloc_bump_begin): a carved-out block served by a
+ * moving pointer. The cursor is only ever rounded up to the allocation's own
+ * size before it advances, so every block handed out sits at a naturally
+ * aligned offset -- a legal buddy block that frees and coalesces like any
+ * other. Whatever the rounding skips is immediately decomposed into
+ * power-of-two blocks and published back to the freelists.
+ */
+
+// Attach [from, to) -- arena-relative, multiples of the minimum block size
+// -- as the greedy sequence of largest naturally aligned blocks.
+static void publish_range(bdalloc_t *allocator, u64 from, u64 to) {
+  while (from < to) {
+    u64 order = _BD_LOG2I(from == 0 ? allocator->size : from);
+    while (from + (1UL << order) > to)
+      order--;
+
+    freelist_t *block = (freelist_t *)((char *)allocator->arena + from);
+    _BD_ORDER_LOCK(allocator, order);
+    blocks_attach(allocator, order, block);
+    _BD_ORDER_UNLOCK(allocator, order);
+
+    from += 1UL << order;
+  }
+}
+
+static void *bump_take(bdalloc_t *allocator, u64 alloc_order) {
+  u64 alloc_size = 1UL << alloc_order;
+  u64 cur = (u64)(allocator->bump_cur - (char *)allocator->arena);
+  u64 end = (u64)(allocator->bump_end - (char *)allocator->arena);
+
+  u64 aligned = (cur + alloc_size - 1) & ~(alloc_size - 1);
+  if (aligned + alloc_size > end)
+    return NULL; // out of region; the caller falls back to the buddy path
+
+  // the alignment hole is perfectly good free memory
+  if (aligned != cur)
+    publish_range(allocator, cur, aligned);
+
+  allocator->bump_cur = (char *)allocator->arena + aligned + alloc_size;
+  allocator->bytes_in_use += alloc_size;
+  if (allocator->bytes_in_use > allocator->peak_in_use)
+    allocator->peak_in_use = allocator->bytes_in_use;
+
+  freelist_t *block = (freelist_t *)((char *)allocator->arena + aligned);
+  void *mem = freelist_to_user_blk(block, alloc_order);
+  _BD_TRACE(BDALLOC_TRACE_ALLOC, alloc_order, mem);
+
+  return mem;
+}
+
+extern int bdalloc_bump_begin(bdalloc_t *allocator) {
+  if (allocator->bump_cur != NULL || allocator->order_mask == 0)
+    return -1;
+
+  // carve off the largest free block as the region
+  u64 order = 63 - __builtin_clzll(allocator->order_mask);
+  _BD_ORDER_LOCK(allocator, order);
+  freelist_t *block = blocks_detach(allocator, order);
+  _BD_ORDER_UNLOCK(allocator, order);
+
+  allocator->bump_cur = (char *)block;
+  allocator->bump_end = (char *)block + (1UL << order);
+
+  return 0;
+}
+
+extern void bdalloc_bump_end(bdalloc_t *allocator) {
+  if (allocator->bump_cur == NULL)
+    return;
+
+  u64 cur = (u64)(allocator->bump_cur - (char *)allocator->arena);
+  u64 end = (u64)(allocator->bump_end - (char *)allocator->arena);
+  allocator->bump_cur = NULL;
+  allocator->bump_end = NULL;
+
+  publish_range(allocator, cur, end);
+}
+
+/* Allocate SIZE bytes */
+extern void *bdalloc(bdalloc_t *allocator, u64 size) {
+  // Find out the size (and corresponding order) we are going to allocate.
+  u64 alloc_size = max(size, _BD_MIN_ALLOC_SIZE);
+  alloc_size = next_power_of_two(alloc_size + _BD_BLOCK_HEADER_SIZE);
+  u64 alloc_order = _BD_LOG2I(alloc_size);
+
+#ifdef __linux__
+  // too big for every arena in the chain: passthrough to a dedicated mmap
+  // instead of fragmenting (or failing) the buddy arena
+  u64 top_order = arena_order(allocator);
+  for (bdalloc_t *a = allocator->next_arena; a != NULL; a = a->next_arena)
+    top_order = max(top_order, arena_order(a));
+  if (alloc_order > top_order)
+    return large_alloc(allocator, size);
+#endif
+
+  // the guaranteed-latency path: one pop from the reserved pool, ahead of
+  // the occupancy scan and any splitting
+  freelist_t *block = reserve_take(allocator, alloc_order);
+  if (block != NULL) {
+    void *mem = freelist_to_user_blk(block, alloc_order);
+    _BD_TRACE(BDALLOC_TRACE_ALLOC, alloc_order, mem);
+
+    return mem;
+  }
+
+  // active bump region: a pointer increment while the region lasts
+  if (allocator->bump_cur != NULL) {
+    void *mem = bump_take(allocator, alloc_order);
+    if (mem != NULL)
+      return mem;
+  }
+
+  block = chain_take_block(allocator, alloc_order);
+  if (block == NULL)
+    return NULL;
+
+  // Write the headers onto the owned block
+  void *mem = freelist_to_user_blk(block, alloc_order);
+  _BD_TRACE(BDALLOC_TRACE_ALLOC, alloc_order, mem);
+
+  return mem;
+}
+
+/* Allocate a block of exactly the given order, skipping the size-to-order
+ * rounding. This is the target of the BDALLOC_FIXED macro: for a
+ * compile-time-constant size the rounding math folds away and a hot
+ * fixed-size call site is just the freelist pop. */
+extern void *bdalloc_order(bdalloc_t *allocator, u64 order) {
+  freelist_t *block = chain_take_block(allocator, order);
+  if (block == NULL)
+    return NULL;
+
+  return freelist_to_user_blk(block, order);
+}
+
+/* The order a sized (headerless) request for SIZE bytes rounds up to */
+inline u64 sized_alloc_order(u64 size) {
+  u64 alloc_size = next_power_of_two(max(size, _BD_MIN_ALLOC_SIZE));
+
+  return _BD_LOG2I(alloc_size);
+}
+
+/* Allocate SIZE bytes with no block header. The caller owns the full power of
+ * two and must free through `bdalloc_free_sized` with the same size. */
+extern void *bdalloc_sized(bdalloc_t *allocator, u64 size) {
+  return (void *)chain_take_block(allocator, sized_alloc_order(size));
+}
+
+// The order an ALIGNMENT/SIZE pair rounds up to: alignment beyond the size
+// is bought by bumping the order, never by over-allocating and offsetting
+inline u64 aligned_alloc_order(u64 alignment, u64 size) {
+  return max(sized_alloc_order(size), (u64)_BD_LOG2I(max(alignment, 1)));
+}
+
+/* Allocate SIZE bytes at an ALIGNMENT-byte boundary. Headerless blocks are
+ * the block itself, already size-aligned within the arena, so a 4KB-aligned
+ * 4KB buffer costs exactly one 4KB block. */
+extern void *bdalloc_aligned(bdalloc_t *allocator, u64 alignment, u64 size) {
+  // power-of-two alignments only
+  // TODO: @ErrorHandling
+  assert(next_power_of_two(alignment) == alignment);
+
+  void *block =
+      (void *)chain_take_block(allocator, aligned_alloc_order(alignment, size));
+
+  // block alignment is relative to the arena base; arena_init page-aligns
+  // malloc-backed arenas and mmap backings are page-aligned already, so this
+  // only trips for alignments beyond a page on an unaligned custom backing
+  assert(block == NULL || ((u64)block & (alignment - 1)) == 0);
+
+  return block;
+}
+
+/**
+ * Given a pointer to a block that is being deallocated, unwinds the pointer
+ * to reveal the header and returns the allocation order.
+ *
+ * After this method, *block can be threaded back onto the freelist.
+ */
+inline u64 prepare_for_free(void **block) {
+  block_header_t *mem = (block_header_t *)(*block);
+  mem--; // unwind to reveal header
+
+  u64 order = header_order(mem->order_and_flags);
+
+#ifdef BDALLOC_HARDENED
+  // a clear in-use bit means this header was already recycled into freelist
+  // links (double free); anything else off means a stray write hit the header
+  assert((mem->order_and_flags >> 63) == 1 && "bdalloc: double free");
+  assert(mem->order_and_flags == header_make(order) &&
+         "bdalloc: corrupted block header");
+
+  // poison the front of the freed block so stale reads trip fast, capped so
+  // freeing big blocks stays O(1)
+  memset(mem, 0xBD, min(1UL << order, _BD_POISON_BYTES));
+#endif
+
+  // point to the real block (where the header starts). no scrubbing is
+  // needed: attaching to a freelist rewrites the stale header words, and the
+  // buddy state lives in the out-of-band bitmap
+  *block = (void *)mem;
+
+  return order;
+}
+
+// Removes 'block' from the allocator's allocation list 'alloc_list' assuming
+// the block does exist in that list.
+inline void bdalloc_splice_block(freelist_t **alloc_list, freelist_t *block) {
+  // remove the block from the list, fixing up neighboring pointers
+  freelist_splice(block);
+
+  // if it was the first block in the alloc list, fixup the head of the list by
+  // by detaching the current head (i.e. detaching 'block')
+  if (*alloc_list == block)
+    freelist_detach(alloc_list);
+}
+
+// bdalloc_splice_block plus the buddy state bitmap upkeep
+static void blocks_splice(bdalloc_t *allocator, u64 order, freelist_t *entry) {
+  bdalloc_splice_block(&allocator->orders[order].head, entry);
+  allocator->orders[order].count--;
+  if (allocator->orders[order].head == NULL)
+    _BD_WORD_AND(&allocator->order_mask, ~(1UL << order));
+  if (order < arena_order(allocator))
+    pair_bit_toggle(allocator, entry, order);
+#ifdef __linux__
+  trim_mark_resident(allocator, entry, order);
+#endif
+}
+
+/**
+ * One lazy-coalescing sweep over a single order's freelist.
+ *
+ * For a node that is on the list, a pair bit of 0 means its buddy is on the
+ * list too (the bit is the XOR of the two siblings' list membership), so the
+ * pair can be merged. Merged blocks are attached one order up; the caller
+ * decides whether that order needs a sweep of its own.
+ *
+ * Lock ordering: holds the order's lock for the whole sweep and takes
+ * order+1 only for the attach, i.e. locks are always acquired in ascending
+ * order, which keeps this deadlock-free against every other path.
+ */
+static void coalesce_order_pass(bdalloc_t *allocator, u64 order) {
+  if (order >= arena_order(allocator))
+    return;
+
+  _BD_ORDER_LOCK(allocator, order);
+
+  freelist_t *node = allocator->orders[order].head;
+  while (node != NULL) {
+    freelist_t *next = node->next;
+
+    if (pair_bit_get(allocator, node, order) == 0) {
+      freelist_t *bud = get_sibling_addr(allocator->arena, node, order);
+
+      // don't resume the walk on the buddy we are about to splice off
+      if (next == bud)
+        next = bud->next;
+
+      blocks_splice(allocator, order, node);
+      blocks_splice(allocator, order, bud);
+      allocator->coalesce_count++;
+      _BD_TRACE(BDALLOC_TRACE_MERGE, order, node);
+
+      freelist_t *merged = node;
+      if (min((u64)node, (u64)bud) == (u64)bud)
+        merged = bud;
+
+      _BD_ORDER_LOCK(allocator, order + 1);
+      blocks_attach(allocator, order + 1, merged);
+      _BD_ORDER_UNLOCK(allocator, order + 1);
+    }
+
+    node = next;
+  }
+
+  _BD_ORDER_UNLOCK(allocator, order);
+}
+
+// Iteratively colaesces an owned (detached) block of a given order with it's
+// buddy, provided that the buddy is free, and attaches the result to the
+// freelist of the order the merging stopped at. A non-zero max_merge_levels
+// on the allocator bounds how many levels one call may climb; the rest is
+// finished by a later sweep, keeping the worst-case free latency fixed
+// instead of proportional to log2 of the arena.
+void coalesce_at_order(bdalloc_t *allocator, freelist_t *block, u64 order,
+                       u64 max_order) {
+  u64 merged = 0;
+
+  while (order < max_order && (allocator->max_merge_levels == 0 ||
+                               merged < allocator->max_merge_levels)) {
+    _BD_ORDER_LOCK(allocator, order);
+
+    // consult the out-of-band bitmap: the block itself is detached, so a set
+    // pair bit means exactly that its buddy is free at this order
+    if (pair_bit_get(allocator, block, order) == 0) {
+      // no merge possible; the block goes onto this order's freelist
+      blocks_attach(allocator, order, block);
+      _BD_ORDER_UNLOCK(allocator, order);
+
+      return;
+    }
+
+    // splice off the buddy from its allocation list; the block itself is
+    // owned and was never attached
+    freelist_t *bud = get_sibling_addr(allocator->arena, block, order);
+    blocks_splice(allocator, order, bud);
+    allocator->coalesce_count++;
+    _BD_TRACE(BDALLOC_TRACE_MERGE, order, block);
+
+    _BD_ORDER_UNLOCK(allocator, order);
+
+    // the smaller of the two addresses is the combined block, which we own
+    if ((u64)bud < (u64)block)
+      block = bud;
+    order++;
+    merged++;
+  }
+
+  // the top of the arena, or the merge budget for this call ran out
+  _BD_ORDER_LOCK(allocator, order);
+  blocks_attach(allocator, order, block);
+  _BD_ORDER_UNLOCK(allocator, order);
+}
+
+/**
+ * Returns an owned block of the given order to the allocator.
+ *
+ * Eager mode merges the block upward immediately. Lazy mode just attaches it
+ * and only sweeps orders whose freelists have grown past the watermark, so
+ * the common free of a hot block size is one list push.
+ */
+static void free_block(bdalloc_t *allocator, freelist_t *block, u64 order) {
+  // refilling a depleted reserve re-pins the block: it stays counted as
+  // in-use and skips coalescing, so the free is O(1) too
+  if (reserve_put(allocator, block, order))
+    return;
+
+  allocator->bytes_in_use -= 1UL << order;
+
+  if (allocator->lazy_watermark == 0) {
+    coalesce_at_order(allocator, block, order, arena_order(allocator));
+  } else {
+    _BD_ORDER_LOCK(allocator, order);
+    blocks_attach(allocator, order, block);
+    _BD_ORDER_UNLOCK(allocator, order);
+
+    // sweep upward while the merging keeps tipping orders over the watermark
+    for (u64 o = order; o < arena_order(allocator) &&
+                        allocator->orders[o].count > allocator->lazy_watermark;
+         ++o) {
+      coalesce_order_pass(allocator, o);
+    }
+  }
+
+#ifdef __linux__
+  // automatic decommit: past a spike, frees push the resident part of the
+  // free set over the watermark and the excess goes back to the OS right
+  // away. Already-decommitted bytes don't count, so in the steady state
+  // below the watermark this is one compare and no freelist walk.
+  u64 resident_free =
+      allocator->size - allocator->bytes_in_use - allocator->trimmed_bytes;
+  if (allocator->trim_watermark != 0 &&
+      resident_free > allocator->trim_watermark)
+    bdalloc_trim(allocator, resident_free - allocator->trim_watermark);
+#endif
+}
+
+extern void bdalloc_set_lazy_coalesce(bdalloc_t *allocator, u64 watermark) {
+  allocator->lazy_watermark = watermark;
+}
+
+extern void bdalloc_set_max_merge_levels(bdalloc_t *allocator, u64 levels) {
+  allocator->max_merge_levels = levels;
+}
+
+/* Size the reserved pool of ORDER to exactly COUNT pinned blocks, paying the
+ * split cascades now so reserved-order allocations never do. Returns the
+ * pool size reached (short only on arena exhaustion). */
+extern u64 bdalloc_reserve(bdalloc_t *allocator, u64 order, u64 count) {
+  // TODO: @ErrorHandling
+  assert(order >= _BD_MIN_ALLOC_ORDER && order < _BD_MAX_MEM_ORDER);
+
+  allocator->reserve_target[order] = count;
+
+  // shrink: hand the excess back to the buddy system (the lowered target is
+  // already in place, so free_block will not re-pin them)
+  while (allocator->reserve[order].count > count) {
+    freelist_t *block = reserve_take(allocator, order);
+    free_block(allocator, block, order);
+  }
+
+  // grow: pre-split through the normal take path, which also books the
+  // pinned blocks as in-use
+  while (allocator->reserve[order].count < count) {
+    freelist_t *block = take_block(allocator, order);
+    if (block == NULL)
+      break;
+
+    _BD_ORDER_LOCK(allocator, order);
+    freelist_push(&allocator->reserve[order].head, block);
+    allocator->reserve[order].count++;
+    _BD_ORDER_UNLOCK(allocator, order);
+  }
+
+  return allocator->reserve[order].count;
+}
+
+/* Free a block allocated by `bdalloc`. This only returns the block to the
+ * allocator, not necessarily to the system. */
+extern void bdalloc_free(bdalloc_t *allocator, void *blk) {
+#ifdef __linux__
+  // passthrough blocks live outside every arena; the registry probe is one
+  // load when (as usual) there are none
+  if (large_free(allocator, blk))
+    return;
+#endif
+
+  bdalloc_t *owner = owning_arena(allocator, blk);
+  assert(owner != NULL);
+
+  u64 order = prepare_for_free(&blk);
+  _BD_TRACE(BDALLOC_TRACE_FREE, order, blk);
+
+  free_block(owner, (freelist_t *)blk, order);
+}
+
+/* Allocate N blocks of SIZE bytes, computing the order once for the batch */
+extern u64 bdalloc_bulk(bdalloc_t *allocator, u64 size, void **out, u64 n) {
+  u64 alloc_size = max(size, _BD_MIN_ALLOC_SIZE);
+  alloc_size = next_power_of_two(alloc_size + _BD_BLOCK_HEADER_SIZE);
+  u64 alloc_order = _BD_LOG2I(alloc_size);
+
+  u64 i = 0;
+  for (; i < n; ++i) {
+    freelist_t *block = chain_take_block(allocator, alloc_order);
+    if (block == NULL)
+      break;
+    out[i] = freelist_to_user_blk(block, alloc_order);
+  }
+
+  return i;
+}
+
+static int ptr_cmp(const void *a, const void *b) {
+  u64 pa = (u64)(*(void *const *)a);
+  u64 pb = (u64)(*(void *const *)b);
+
+  return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
+
+/**
+ * Frees a whole batch with a single deferred coalesce pass.
+ *
+ * All blocks are pushed onto their freelists first (in address order, so
+ * buddies freed together sit next to each other), then the pass merges
+ * everything in one sweep per order. Freeing one-at-a-time can never exploit
+ * this: each eager free merges and the next allocation re-splits.
+ */
+extern void bdalloc_free_bulk(bdalloc_t *allocator, void **ptrs, u64 n) {
+  if (n == 0)
+    return;
+
+  qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+  u64 min_order = _BD_MAX_MEM_ORDER;
+  for (u64 i = 0; i < n; ++i) {
+    void *blk = ptrs[i];
+#ifdef __linux__
+    // same routing as bdalloc_free: passthrough blocks go to munmap and
+    // take no part in the coalesce pass
+    if (large_free(allocator, blk))
+      continue;
+#endif
+    bdalloc_t *owner = owning_arena(allocator, blk);
+    assert(owner != NULL);
+
+    u64 order = prepare_for_free(&blk);
+    owner->bytes_in_use -= 1UL << order;
+    _BD_ORDER_LOCK(owner, order);
+    blocks_attach(owner, order, (freelist_t *)blk);
+    _BD_ORDER_UNLOCK(owner, order);
+
+    min_order = min(min_order, order);
+  }
+
+  // under lazy coalescing the blocks just stay parked; otherwise merge the
+  // batch now, sweeping upward so merges cascade
+  if (allocator->lazy_watermark != 0)
+    return;
+
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    for (u64 o = min_order; o < arena_order(a); ++o) {
+      coalesce_order_pass(a, o);
+    }
+  }
+}
+
+/* Aggregate the per-arena counters into a stats snapshot. orders[] gives
+ * the per-order free bytes directly and order_mask the largest free block, so
+ * nothing here ever touches a freelist node; open_pairs costs one pass over
+ * the pair bitmap (see bitmap_popcount). */
+extern void bdalloc_stats(bdalloc_t *allocator, bdalloc_stats_t *out) {
+  out->bytes_in_use = 0;
+  out->peak_in_use = 0;
+  out->bytes_free = 0;
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i)
+    out->free_bytes_per_order[i] = 0;
+  out->split_count = 0;
+  out->coalesce_count = 0;
+  out->large_bytes = 0;
+  out->open_pairs = 0;
+
+  u64 largest_free = 0;
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    out->bytes_in_use += a->bytes_in_use;
+    out->peak_in_use += a->peak_in_use;
+    out->split_count += a->split_count;
+    out->coalesce_count += a->coalesce_count;
+#ifdef __linux__
+    out->large_bytes += a->large_bytes;
+#endif
+
+    // every set pair bit is a free block whose buddy is not
+    u64 pair_bit_words = ((a->size >> _BD_MIN_ALLOC_ORDER) + 63) >> 6;
+    out->open_pairs += bitmap_popcount(a->pair_bits, pair_bit_words);
+
+    for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+      u64 bytes = a->orders[i].count << i;
+      out->free_bytes_per_order[i] += bytes;
+      out->bytes_free += bytes;
+    }
+
+    if (a->order_mask != 0)
+      largest_free =
+          max(largest_free, 1UL << (63 - __builtin_clzll(a->order_mask)));
+  }
+
+  out->fragmentation =
+      out->bytes_free == 0
+          ? 0.0
+          : 1.0 - (double)largest_free / (double)out->bytes_free;
+}
+
+/**
+ * Epoch bulk reset.
+ *
+ * Request-shaped workloads allocate a pile of temporaries and free them all
+ * at once; paying a coalescing walk per block for memory that dies together
+ * is wasted work. An epoch records the (offset, order) of every free block,
+ * and a reset rebuilds the freelists from that recording: the pair bitmap is
+ * re-toggled from all-zero by blocks_attach and pushing a node rewrites its
+ * link words, which is all the "header wiping" a freed block needs. The cost
+ * is O(blocks free at begin) -- typically a handful after coalescing -- no
+ * matter how much was allocated, split or merged during the epoch.
+ */
+
+typedef struct epoch_block_t {
+  u64 off;
+  u64 order;
+} epoch_block_t;
+
+typedef struct bdalloc_epoch_t {
+  epoch_block_t *blocks;
+  u64 count;
+  u64 bytes_in_use;
+} bdalloc_epoch_t;
+
+extern int bdalloc_epoch_begin(bdalloc_t *allocator) {
+  // a reset cannot unwind chain growth, so epochs are single-arena, like
+  // snapshots
+  // TODO: @ErrorHandling
+  assert(allocator->next_arena == NULL);
+
+  bdalloc_epoch_end(allocator);
+
+  bdalloc_epoch_t *epoch = (bdalloc_epoch_t *)malloc(sizeof(bdalloc_epoch_t));
+  if (epoch == NULL)
+    return -1;
+
+  u64 total = 0;
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i)
+    total += allocator->orders[i].count;
+
+  epoch->blocks = (epoch_block_t *)malloc(total * sizeof(epoch_block_t));
+  if (epoch->blocks == NULL) {
+    free(epoch);
+    return -1;
+  }
+
+  epoch->count = 0;
+  for (u64 o = 0; o < _BD_MAX_MEM_ORDER; ++o) {
+    for (freelist_t *b = allocator->orders[o].head; b != NULL; b = b->next) {
+      epoch->blocks[epoch->count].off = (u64)b - (u64)allocator->arena;
+      epoch->blocks[epoch->count].order = o;
+      epoch->count++;
+    }
+  }
+  epoch->bytes_in_use = allocator->bytes_in_use;
+
+  allocator->epoch = epoch;
+
+  return 0;
+}
+
+extern void bdalloc_epoch_reset(bdalloc_t *allocator) {
+  bdalloc_epoch_t *epoch = allocator->epoch;
+
+  // resetting without an epoch, or after growing past one arena
+  // TODO: @ErrorHandling
+  assert(epoch != NULL);
+  assert(allocator->next_arena == NULL);
+
+  // wipe the derived state, then re-attach exactly the recorded free set
+  u64 pair_bit_words = ((allocator->size >> _BD_MIN_ALLOC_ORDER) + 63) >> 6;
+  memset(allocator->pair_bits, 0, pair_bit_words * sizeof(uint64_t));
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    allocator->orders[i].head = NULL;
+    allocator->orders[i].count = 0;
+  }
+  allocator->order_mask = 0;
+#ifdef __linux__
+  // the re-attached free set is treated as resident; a later trim re-advises
+  memset(allocator->trim_bits, 0,
+         trim_bit_words(allocator->size) * sizeof(uint64_t));
+  allocator->trimmed_bytes = 0;
+#endif
+
+  for (u64 i = 0; i < epoch->count; ++i)
+    blocks_attach(
+        allocator, epoch->blocks[i].order,
+        (freelist_t *)((char *)allocator->arena + epoch->blocks[i].off));
+
+  allocator->bytes_in_use = epoch->bytes_in_use;
+}
+
+extern void bdalloc_epoch_end(bdalloc_t *allocator) {
+  if (allocator->epoch == NULL)
+    return;
+
+  free(allocator->epoch->blocks);
+  free(allocator->epoch);
+  allocator->epoch = NULL;
+}
+
+#ifdef __linux__
+/**
+ * Arena decommit.
+ *
+ * A free block's pages stay resident forever otherwise ("returns the block
+ * to the allocator, not necessarily to the system"). Trimming walks the high
+ * orders and MADV_DONTNEED's the interior of each free block -- everything
+ * past the first page, which holds the freelist node and must stay resident.
+ * The kernel reclaims the physical pages and faults in fresh zero pages if
+ * the block is ever split and reused, so no allocator state is lost.
+ */
+
+static u64 decommit_block(bdalloc_t *allocator, freelist_t *block, u64 order) {
+  // blocks this large are page-aligned (arena bases are page-aligned and
+  // block offsets are multiples of the block size)
+  assert(((u64)block & 4095) == 0);
+
+  // still sitting untouched on the freelist since the last trim: the advise
+  // would be a no-op syscall, and counting it again would let repeat trims
+  // claim progress they did not make
+  if (trim_bit_get(allocator, block))
+    return 0;
+
+  char *interior = (char *)block + 4096;
+  u64 len = (1UL << order) - 4096;
+  if (madvise(interior, len, MADV_DONTNEED) != 0)
+    return 0;
+
+  trim_bit_set(allocator, block);
+  allocator->trimmed_bytes += len;
+
+  return len;
+}
+
+/* Release the physical pages of free high-order blocks back to the OS,
+ * largest blocks first, until at least TARGET_BYTES have been released (0 =
+ * release everything releasable). Freelist state is untouched; a trimmed
+ * block costs page faults when reused. Blocks already advised (and not
+ * touched since, see trim_mark_resident) are remembered and skipped, so
+ * calling this again after more frees advises -- and counts -- only the new
+ * blocks' worth. Returns the bytes newly advised by this call. */
+extern u64 bdalloc_trim(bdalloc_t *allocator, u64 target_bytes) {
+  u64 released = 0;
+
+  for (bdalloc_t *a = allocator; a != NULL; a = a->next_arena) {
+    for (u64 o = arena_order(a) + 1; o-- > _BD_TRIM_MIN_ORDER;) {
+      _BD_ORDER_LOCK(a, o);
+      for (freelist_t *node = a->orders[o].head; node != NULL;
+           node = node->next) {
+        released += decommit_block(a, node, o);
+        if (target_bytes != 0 && released >= target_bytes) {
+          _BD_ORDER_UNLOCK(a, o);
+          return released;
+        }
+      }
+      _BD_ORDER_UNLOCK(a, o);
+    }
+  }
+
+  return released;
+}
+
+extern void bdalloc_set_trim_watermark(bdalloc_t *allocator, u64 watermark) {
+  allocator->trim_watermark = watermark;
+}
+
+/**
+ * Snapshot/restore.
+ *
+ * A checkpoint is the snapshot header (bdalloc_t scalars plus the freelist
+ * heads and counts as arena-relative offsets), the pair bitmap, padding to a
+ * page boundary, and the raw arena. The only pointers living inside the
+ * arena are the freelist nodes' prev/next links, so those are rewritten as
+ * offsets for the write and rewritten back afterwards; everything else in
+ * the arena is user data and goes out verbatim. Restoring maps the arena
+ * portion of the file MAP_PRIVATE, so a restart pays one mmap and faults
+ * pages in lazily as the object graph is walked.
+ */
+#define _BD_SNAPSHOT_MAGIC 0x3150414e53414442UL // "BDASNAP1"
+
+// offsets are arena-relative; NULL needs a value no offset can take
+#define _BD_SNAP_NULL (~0UL)
+
+typedef struct snapshot_header_t {
+  u64 magic;
+  u64 size;
+  u64 order_mask;
+  u64 lazy_watermark;
+  u64 max_merge_levels;
+  u64 bytes_in_use;
+  u64 peak_in_use;
+  u64 split_count;
+  u64 coalesce_count;
+  u64 head_off[_BD_MAX_MEM_ORDER];
+  u64 count[_BD_MAX_MEM_ORDER];
+} snapshot_header_t;
+
+inline u64 snapshot_pair_bit_bytes(u64 size) {
+  return (((size >> _BD_MIN_ALLOC_ORDER) + 63) >> 6) * sizeof(u64);
+}
+
+// where the arena starts in the file: header + bitmap, padded to a page so
+// the arena can be mmap'd straight out of the checkpoint
+inline u64 snapshot_arena_off(u64 size) {
+  u64 off = sizeof(snapshot_header_t) + snapshot_pair_bit_bytes(size);
+
+  return (off + 4095) & ~4095UL;
+}
+
+static int write_all(int fd, const void *buf, u64 n) {
+  const char *p = (const char *)buf;
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w <= 0)
+      return -1;
+    p += w;
+    n -= (u64)w;
+  }
+
+  return 0;
+}
+
+static int read_all(int fd, void *buf, u64 n) {
+  char *p = (char *)buf;
+  while (n > 0) {
+    ssize_t r = read(fd, p, n);
+    if (r <= 0)
+      return -1;
+    p += r;
+    n -= (u64)r;
+  }
+
+  return 0;
+}
+
+// rewrite every freelist node's links from offsets back to pointers. used
+// both after a restore and to undo the encoding a snapshot does in place;
+// the walk follows the offset stored in the node before decoding it
+static void snapshot_decode_lists(bdalloc_t *allocator) {
+  char *base = (char *)allocator->arena;
+
+  for (int o = 0; o < _BD_MAX_MEM_ORDER; ++o) {
+    freelist_t *node = allocator->orders[o].head;
+    while (node != NULL) {
+      u64 poff = (u64)node->prev;
+      u64 noff = (u64)node->next;
+
+      node->prev =
+          poff == _BD_SNAP_NULL ? NULL : (freelist_t *)(base + poff);
+      node->next =
+          noff == _BD_SNAP_NULL ? NULL : (freelist_t *)(base + noff);
+      node = node->next;
+    }
+  }
+}
+
+/* Write a checkpoint of the allocator to FD. The allocator stays fully
+ * usable afterwards. Returns 0 on success, -1 on a short write. */
+extern int bdalloc_snapshot(bdalloc_t *allocator, int fd) {
+  // a chain cannot be checkpointed into one relocatable file
+  // TODO: @ErrorHandling
+  assert(allocator->next_arena == NULL);
+
+  char *base = (char *)allocator->arena;
+
+  snapshot_header_t hdr;
+  hdr.magic = _BD_SNAPSHOT_MAGIC;
+  hdr.size = allocator->size;
+  hdr.order_mask = allocator->order_mask;
+  hdr.lazy_watermark = allocator->lazy_watermark;
+  hdr.max_merge_levels = allocator->max_merge_levels;
+  hdr.bytes_in_use = allocator->bytes_in_use;
+  hdr.peak_in_use = allocator->peak_in_use;
+  hdr.split_count = allocator->split_count;
+  hdr.coalesce_count = allocator->coalesce_count;
+  for (int o = 0; o < _BD_MAX_MEM_ORDER; ++o) {
+    freelist_t *head = allocator->orders[o].head;
+    hdr.head_off[o] = head == NULL ? _BD_SNAP_NULL : (u64)((char *)head - base);
+    hdr.count[o] = allocator->orders[o].count;
+  }
+
+  // encode the in-arena links as offsets for the duration of the write
+  for (int o = 0; o < _BD_MAX_MEM_ORDER; ++o) {
+    freelist_t *node = allocator->orders[o].head;
+    while (node != NULL) {
+      freelist_t *next = node->next;
+
+      node->prev = (freelist_t *)(node->prev == NULL
+                                      ? _BD_SNAP_NULL
+                                      : (u64)((char *)node->prev - base));
+      node->next = (freelist_t *)(next == NULL ? _BD_SNAP_NULL
+                                               : (u64)((char *)next - base));
+      node = next;
+    }
+  }
+
+  static const char zeros[4096] = {0};
+  u64 pad = snapshot_arena_off(allocator->size) -
+            sizeof(snapshot_header_t) - snapshot_pair_bit_bytes(allocator->size);
+
+  int rc = write_all(fd, &hdr, sizeof(hdr));
+  if (rc == 0)
+    rc = write_all(fd, allocator->pair_bits,
+                   snapshot_pair_bit_bytes(allocator->size));
+  if (rc == 0)
+    rc = write_all(fd, zeros, pad);
+  if (rc == 0)
+    rc = write_all(fd, allocator->arena, allocator->size);
+
+  // the allocator keeps running: decode the links back to pointers
+  snapshot_decode_lists(allocator);
+
+  return rc;
+}
+
+/* Restore an allocator from a checkpoint at the current offset of FD. The
+ * arena is mapped MAP_PRIVATE out of the file (relocatable, lazily faulted;
+ * modifications do not touch the checkpoint). Returns the arena, or NULL on
+ * a bad or truncated checkpoint. FD may be closed after this returns. */
+extern void *bdalloc_restore(bdalloc_t *allocator, int fd) {
+  u64 start = (u64)lseek(fd, 0, SEEK_CUR);
+
+  snapshot_header_t hdr;
+  if (read_all(fd, &hdr, sizeof(hdr)) != 0 || hdr.magic != _BD_SNAPSHOT_MAGIC)
+    return NULL;
+
+  u64 bit_bytes = snapshot_pair_bit_bytes(hdr.size);
+  allocator->pair_bits = (uint64_t *)malloc(bit_bytes);
+  if (allocator->pair_bits == NULL)
+    return NULL;
+  if (read_all(fd, allocator->pair_bits, bit_bytes) != 0) {
+    free(allocator->pair_bits);
+    return NULL;
+  }
+
+  // the arena portion sits page-aligned in the file, so it can be mapped
+  // directly; the checkpoint must itself start page-aligned for this
+  assert((start & 4095) == 0);
+  allocator->arena = mmap(NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fd, start + snapshot_arena_off(hdr.size));
+  if (allocator->arena == MAP_FAILED) {
+    free(allocator->pair_bits);
+    return NULL;
+  }
+
+  allocator->size = hdr.size;
+  allocator->order_mask = hdr.order_mask;
+  allocator->lazy_watermark = hdr.lazy_watermark;
+  allocator->max_merge_levels = hdr.max_merge_levels;
+  allocator->trim_watermark = 0;
+  allocator->bytes_in_use = hdr.bytes_in_use;
+  allocator->peak_in_use = hdr.peak_in_use;
+  allocator->split_count = hdr.split_count;
+  allocator->coalesce_count = hdr.coalesce_count;
+  allocator->next_arena = NULL;
+  allocator->growable = 0;
+  allocator->epoch = NULL;
+  allocator->bump_cur = NULL;
+  allocator->bump_end = NULL;
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    allocator->reserve[i].head = NULL;
+    allocator->reserve[i].count = 0;
+    allocator->reserve_target[i] = 0;
+  }
+  for (int i = 0; i < _BD_LARGE_BUCKETS; ++i)
+    allocator->large[i] = NULL;
+  allocator->large_bytes = 0;
+
+  // the fresh mapping is all lazily faulted anyway; nothing is decommitted
+  allocator->trim_bits =
+      (uint64_t *)calloc(trim_bit_words(hdr.size), sizeof(uint64_t));
+  if (allocator->trim_bits == NULL) {
+    munmap(allocator->arena, hdr.size);
+    free(allocator->pair_bits);
+    return NULL;
+  }
+  allocator->trimmed_bytes = 0;
+
+  // deinit (and any growing) goes through mmap, like bdalloc_init_mmap
+  allocator->map = bd_mmap_map;
+  allocator->unmap = bd_mmap_unmap;
+  allocator->map_user = NULL;
+  allocator->foreign_arena = 0;
+
+  char *base = (char *)allocator->arena;
+  for (int o = 0; o < _BD_MAX_MEM_ORDER; ++o) {
+    allocator->orders[o].head =
+        hdr.head_off[o] == _BD_SNAP_NULL
+            ? NULL
+            : (freelist_t *)(base + hdr.head_off[o]);
+    allocator->orders[o].count = hdr.count[o];
+  }
+  snapshot_decode_lists(allocator);
+
+#ifdef BDALLOC_CONCURRENT
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    pthread_mutex_init(&allocator->order_locks[i], NULL);
+  }
+  pthread_mutex_init(&allocator->grow_lock, NULL);
+#endif
+
+  return allocator->arena;
+}
+#endif
+
+/**
+ * Resizes a block allocated by `bdalloc`, preferring in-place surgery.
+ *
+ * Growing: while this block is the lower sibling of its pair and the buddy
+ * sits free on the freelist, the buddy is spliced off and absorbed, doubling
+ * the block without moving a byte. Shrinking peels the upper halves off and
+ * returns them to the allocator. Only when growth hits an in-use (or
+ * upper-sibling) boundary does the data get copied into a fresh block.
+ */
+extern void *bdalloc_realloc(bdalloc_t *allocator, void *ptr, u64 new_size) {
+  if (ptr == NULL)
+    return bdalloc(allocator, new_size);
+  if (new_size == 0) {
+    bdalloc_free(allocator, ptr);
+    return NULL;
+  }
+
+#ifdef __linux__
+  // passthrough blocks have no header and no buddy; they resize at the
+  // mapping level instead
+  void *moved;
+  if (large_realloc(allocator, ptr, new_size, &moved))
+    return moved;
+#endif
+
+  bdalloc_t *owner = owning_arena(allocator, ptr);
+  assert(owner != NULL);
+
+  u64 cur_order = bdalloc_block_order(ptr);
+  u64 new_order = bdalloc_alloc_order(new_size);
+  block_header_t *block = (block_header_t *)ptr - 1;
+
+  if (new_order == cur_order)
+    return ptr;
+
+  if (new_order < cur_order) {
+    // shrink in place: peel the upper halves back onto the freelists. each
+    // tail's buddy is this still-live block, so no merging happens
+    while (cur_order > new_order) {
+      cur_order--;
+      freelist_t *tail = get_sibling_addr(owner->arena, block, cur_order);
+      free_block(owner, tail, cur_order);
+    }
+    block->order_and_flags = header_make(new_order);
+
+    return ptr;
+  }
+
+  // grow in place while this block is the lower sibling and its buddy is
+  // free. the block itself is in use (off the lists), so a set pair bit
+  // means exactly that the buddy is free at this order
+  u64 offset = (u64)block - (u64)owner->arena;
+  u64 order = cur_order;
+  while (order < new_order && order < arena_order(owner) &&
+         ((offset >> order) & 1) == 0) {
+    _BD_ORDER_LOCK(owner, order);
+    if (pair_bit_get(owner, block, order) == 0) {
+      _BD_ORDER_UNLOCK(owner, order);
+      break;
+    }
+    blocks_splice(owner, order, get_sibling_addr(owner->arena, block, order));
+    _BD_ORDER_UNLOCK(owner, order);
+
+    // the absorbed buddy is now part of this live block
+    owner->bytes_in_use += 1UL << order;
+    if (owner->bytes_in_use > owner->peak_in_use)
+      owner->peak_in_use = owner->bytes_in_use;
+    order++;
+  }
+
+  // record whatever span the block owns now; on the fallback path this lets
+  // the free below return the partially grown block in one piece
+  block->order_and_flags = header_make(order);
+  if (order == new_order)
+    return ptr;
+
+  void *fresh = bdalloc(allocator, new_size);
+  if (fresh == NULL)
+    return NULL;
+
+  u64 old_usable = (1UL << order) - _BD_BLOCK_HEADER_SIZE;
+  memcpy(fresh, ptr, min(old_usable, new_size));
+  bdalloc_free(allocator, ptr);
+
+  return fresh;
+}
+
+/* Free a block allocated by `bdalloc_sized`. The order is derived from the
+ * caller-supplied size; no header is read, so the block's memory is never
+ * touched beyond threading it back onto the freelist. */
+extern void bdalloc_free_sized(bdalloc_t *allocator, void *blk, u64 size) {
+  bdalloc_t *owner = owning_arena(allocator, blk);
+  assert(owner != NULL);
+
+  free_block(owner, (freelist_t *)blk, sized_alloc_order(size));
+}
 
-  u64 max_order = _BD_LOG2I(allocator->size);
+/* Free a block allocated by `bdalloc_aligned` with the same ALIGNMENT and
+ * SIZE */
+extern void bdalloc_free_aligned(bdalloc_t *allocator, void *blk,
+                                 u64 alignment, u64 size) {
+  bdalloc_t *owner = owning_arena(allocator, blk);
+  assert(owner != NULL);
 
-  coalesce_at_order(allocator, freed_blk, order, max_order);
+  free_block(owner, (freelist_t *)blk, aligned_alloc_order(alignment, size));
 }
@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <bdalloc_numa.h>
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef uint64_t u64;
+
+// mbind policy: prefer the given node but fall back rather than fail
+// (constant from linux/mempolicy.h, spelled out to avoid a libnuma
+// dependency)
+#define _BD_MPOL_PREFERRED 1
+
+/**
+ * Backing callbacks for one node's arena: anonymous mmap, bound to the node
+ * encoded in the user pointer.
+ *
+ * The bind is advisory on purpose: if mbind fails (single-node box, kernel
+ * without NUMA), the mapping still works and first-touch placement decides,
+ * which on such machines is the right answer anyway.
+ */
+static void *bd_numa_map(u64 size, void *user) {
+  u64 node = (u64)user;
+
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return NULL;
+
+  u64 nodemask = 1UL << node;
+  syscall(SYS_mbind, mem, size, _BD_MPOL_PREFERRED, &nodemask,
+          sizeof(nodemask) * 8, 0);
+
+  return mem;
+}
+
+static void bd_numa_unmap(void *addr, u64 size, void *user) {
+  (void)user;
+  munmap(addr, size);
+}
+
+extern int bdalloc_numa_init(bdalloc_numa_t *numa, u64 node_count, u64 size) {
+  assert(node_count >= 1 && node_count <= _BD_NUMA_MAX_NODES);
+
+  numa->node_count = node_count;
+  for (u64 n = 0; n < node_count; ++n) {
+    if (bdalloc_init_backed(&numa->nodes[n], size, bd_numa_map, bd_numa_unmap,
+                            (void *)n) == NULL) {
+      while (n > 0)
+        bdalloc_deinit(&numa->nodes[--n]);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+extern u64 bdalloc_numa_node(bdalloc_numa_t *numa) {
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    node = 0;
+
+  // clamp: a box can have more nodes than arenas were configured for
+  return node % numa->node_count;
+}
+
+extern void *bdalloc_numa(bdalloc_numa_t *numa, u64 size) {
+  return bdalloc(&numa->nodes[bdalloc_numa_node(numa)], size);
+}
+
+extern void bdalloc_numa_free(bdalloc_numa_t *numa, void *block) {
+  // route by address range: the freeing thread may be on a different socket
+  // than the one that allocated
+  for (u64 n = 0; n < numa->node_count; ++n) {
+    if (bdalloc_owning_arena(&numa->nodes[n], block) != NULL) {
+      bdalloc_free(&numa->nodes[n], block);
+      return;
+    }
+  }
+
+  // the block belongs to no node arena
+  // TODO: @ErrorHandling
+  assert(0);
+}
+
+extern void bdalloc_numa_deinit(bdalloc_numa_t *numa) {
+  for (u64 n = 0; n < numa->node_count; ++n)
+    bdalloc_deinit(&numa->nodes[n]);
+}
+
+#endif /* __linux__ */
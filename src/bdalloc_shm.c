@@ -0,0 +1,265 @@
+#include <assert.h>
+#include <bdalloc_shm.h>
+#include <pthread.h>
+
+// memset
+#include <string.h>
+
+typedef uint64_t u64;
+
+#define _BD_SHM_MAGIC 0x314d454d48534442UL // "BDSHMEM1"
+
+// mirror the in-process allocator's block geometry: 16-byte minimum blocks,
+// an 8-byte order header on every allocation
+#define _BD_SHM_MIN_ORDER 4
+#define _BD_SHM_MIN_SIZE (1UL << _BD_SHM_MIN_ORDER)
+#define _BD_SHM_HEADER_SIZE 8UL
+#define _BD_SHM_IN_USE (1UL << 63)
+
+/**
+ * A buddy allocator whose every word of state is position independent.
+ *
+ * The in-process allocator keeps its metadata (freelist heads, pair bitmap)
+ * in a private bdalloc_t and threads raw pointers through the arena, which
+ * rules out sharing: a second process maps the segment at a different base
+ * and every link is garbage. Here the whole control block lives inside the
+ * mapping and all links -- order heads and the prev/next words in free
+ * blocks -- are arena-relative offsets (_BD_SHM_NULL for none). The sibling
+ * XOR trick works on offsets unchanged. A process-shared mutex in the
+ * control block serializes the two (or more) attached processes.
+ */
+
+// free blocks carry their list links in their own first 16 bytes, as offsets
+typedef struct shm_node_t {
+  u64 prev;
+  u64 next;
+} shm_node_t;
+
+inline u64 shm_log2i(u64 num) { return (u64)__builtin_ctzll(num); }
+
+inline u64 shm_next_power_of_two(u64 x) {
+  x--;
+
+  x |= x >> 1;
+  x |= x >> 2;
+  x |= x >> 4;
+  x |= x >> 8;
+  x |= x >> 16;
+  x |= x >> 32;
+
+  return ++x;
+}
+
+inline shm_node_t *shm_node(bdalloc_shm_t *shm, u64 off) {
+  return (shm_node_t *)((char *)shm->arena + off);
+}
+
+// the same per-order XOR parity as the in-process allocator's pair bitmap:
+// a set bit means exactly one of the pair is on this order's freelist
+inline u64 shm_pair_bit_index(bdalloc_shm_t *shm, u64 off, u64 order) {
+  u64 region =
+      (shm->hdr->size >> _BD_SHM_MIN_ORDER) - (shm->hdr->size >> order);
+
+  return region + (off >> (order + 1));
+}
+
+inline void shm_pair_bit_toggle(bdalloc_shm_t *shm, u64 off, u64 order) {
+  u64 idx = shm_pair_bit_index(shm, off, order);
+  shm->pair_bits[idx >> 6] ^= 1UL << (idx & 63);
+}
+
+inline int shm_pair_bit_get(bdalloc_shm_t *shm, u64 off, u64 order) {
+  u64 idx = shm_pair_bit_index(shm, off, order);
+
+  return (shm->pair_bits[idx >> 6] >> (idx & 63)) & 0x1;
+}
+
+inline u64 shm_arena_order(bdalloc_shm_t *shm) {
+  return shm_log2i(shm->hdr->size);
+}
+
+// Attach/detach/splice on an order's offset-encoded freelist, keeping count,
+// occupancy mask and pair bitmap in sync -- the offset twin of blocks_* in
+// bdalloc.c. Caller holds the shared lock.
+static void shm_attach(bdalloc_shm_t *shm, u64 order, u64 off) {
+  bdalloc_shm_header_t *hdr = shm->hdr;
+  shm_node_t *node = shm_node(shm, off);
+
+  node->prev = _BD_SHM_NULL;
+  node->next = hdr->orders[order].head;
+  if (hdr->orders[order].head != _BD_SHM_NULL)
+    shm_node(shm, hdr->orders[order].head)->prev = off;
+  hdr->orders[order].head = off;
+
+  hdr->orders[order].count++;
+  hdr->order_mask |= 1UL << order;
+  if (order < shm_arena_order(shm))
+    shm_pair_bit_toggle(shm, off, order);
+}
+
+static u64 shm_detach(bdalloc_shm_t *shm, u64 order) {
+  bdalloc_shm_header_t *hdr = shm->hdr;
+  u64 off = hdr->orders[order].head;
+  shm_node_t *node = shm_node(shm, off);
+
+  hdr->orders[order].head = node->next;
+  if (node->next != _BD_SHM_NULL)
+    shm_node(shm, node->next)->prev = _BD_SHM_NULL;
+
+  hdr->orders[order].count--;
+  if (hdr->orders[order].head == _BD_SHM_NULL)
+    hdr->order_mask &= ~(1UL << order);
+  if (order < shm_arena_order(shm))
+    shm_pair_bit_toggle(shm, off, order);
+
+  return off;
+}
+
+static void shm_splice(bdalloc_shm_t *shm, u64 order, u64 off) {
+  bdalloc_shm_header_t *hdr = shm->hdr;
+  shm_node_t *node = shm_node(shm, off);
+
+  if (node->prev != _BD_SHM_NULL)
+    shm_node(shm, node->prev)->next = node->next;
+  else
+    hdr->orders[order].head = node->next;
+  if (node->next != _BD_SHM_NULL)
+    shm_node(shm, node->next)->prev = node->prev;
+
+  hdr->orders[order].count--;
+  if (hdr->orders[order].head == _BD_SHM_NULL)
+    hdr->order_mask &= ~(1UL << order);
+  if (order < shm_arena_order(shm))
+    shm_pair_bit_toggle(shm, off, order);
+}
+
+inline u64 shm_pair_bit_bytes(u64 size) {
+  return (((size >> _BD_SHM_MIN_ORDER) + 63) >> 6) * sizeof(u64);
+}
+
+inline u64 shm_arena_off(u64 size) {
+  // keep blocks naturally aligned within the mapping
+  u64 off = sizeof(bdalloc_shm_header_t) + shm_pair_bit_bytes(size);
+
+  return (off + 63) & ~63UL;
+}
+
+extern u64 bdalloc_shm_footprint(u64 size) {
+  return shm_arena_off(size) + size;
+}
+
+extern void *bdalloc_shm_init(bdalloc_shm_t *shm, void *base, u64 size) {
+  // TODO: @ErrorHandling
+  assert(size >= _BD_SHM_MIN_SIZE);
+  assert(shm_next_power_of_two(size) == size);
+
+  bdalloc_shm_header_t *hdr = (bdalloc_shm_header_t *)base;
+  hdr->size = size;
+  hdr->arena_off = shm_arena_off(size);
+  hdr->order_mask = 0;
+  hdr->bytes_in_use = 0;
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    hdr->orders[i].head = _BD_SHM_NULL;
+    hdr->orders[i].count = 0;
+  }
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&hdr->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  shm->hdr = hdr;
+  shm->pair_bits = (u64 *)((char *)base + sizeof(bdalloc_shm_header_t));
+  shm->arena = (char *)base + hdr->arena_off;
+
+  memset(shm->pair_bits, 0, shm_pair_bit_bytes(size));
+  shm_attach(shm, shm_arena_order(shm), 0);
+
+  // the magic goes last: an attacher that races the formatting sees no arena
+  // rather than half of one
+  hdr->magic = _BD_SHM_MAGIC;
+
+  return shm->arena;
+}
+
+extern void *bdalloc_attach(bdalloc_shm_t *shm, void *base) {
+  bdalloc_shm_header_t *hdr = (bdalloc_shm_header_t *)base;
+  if (hdr->magic != _BD_SHM_MAGIC)
+    return NULL;
+
+  shm->hdr = hdr;
+  shm->pair_bits = (u64 *)((char *)base + sizeof(bdalloc_shm_header_t));
+  shm->arena = (char *)base + hdr->arena_off;
+
+  return shm->arena;
+}
+
+extern void *bdalloc_shm(bdalloc_shm_t *shm, u64 size) {
+  bdalloc_shm_header_t *hdr = shm->hdr;
+
+  u64 alloc_size = size < _BD_SHM_MIN_SIZE ? _BD_SHM_MIN_SIZE : size;
+  alloc_size = shm_next_power_of_two(alloc_size + _BD_SHM_HEADER_SIZE);
+  u64 alloc_order = shm_log2i(alloc_size);
+
+  pthread_mutex_lock(&hdr->lock);
+
+  // smallest sufficient non-empty order, straight off the occupancy mask
+  u64 candidates = hdr->order_mask & ~((1UL << alloc_order) - 1);
+  if (candidates == 0) {
+    pthread_mutex_unlock(&hdr->lock);
+
+    return NULL;
+  }
+  u64 order = shm_log2i(candidates);
+
+  u64 off = shm_detach(shm, order);
+  while (order > alloc_order) {
+    order--;
+    shm_attach(shm, order, off ^ (1UL << order));
+  }
+
+  hdr->bytes_in_use += 1UL << alloc_order;
+  pthread_mutex_unlock(&hdr->lock);
+
+  *(u64 *)shm_node(shm, off) = alloc_order | _BD_SHM_IN_USE;
+
+  return (char *)shm->arena + off + _BD_SHM_HEADER_SIZE;
+}
+
+extern void bdalloc_shm_free(bdalloc_shm_t *shm, void *block) {
+  bdalloc_shm_header_t *hdr = shm->hdr;
+
+  u64 off = (u64)((char *)block - (char *)shm->arena) - _BD_SHM_HEADER_SIZE;
+  u64 order = *(u64 *)shm_node(shm, off) & ~_BD_SHM_IN_USE;
+
+  pthread_mutex_lock(&hdr->lock);
+  hdr->bytes_in_use -= 1UL << order;
+
+  // the block is owned (never attached), so a set pair bit means exactly
+  // that its buddy is free at this order; merge upward while that holds
+  u64 max_order = shm_arena_order(shm);
+  while (order < max_order && shm_pair_bit_get(shm, off, order)) {
+    u64 bud = off ^ (1UL << order);
+    shm_splice(shm, order, bud);
+    if (bud < off)
+      off = bud;
+    order++;
+  }
+  shm_attach(shm, order, off);
+
+  pthread_mutex_unlock(&hdr->lock);
+}
+
+extern u64 bdalloc_shm_offset(bdalloc_shm_t *shm, void *block) {
+  return (u64)((char *)block - (char *)shm->arena);
+}
+
+extern void *bdalloc_shm_block(bdalloc_shm_t *shm, u64 offset) {
+  return (char *)shm->arena + offset;
+}
+
+extern void bdalloc_shm_deinit(bdalloc_shm_t *shm) {
+  shm->hdr->magic = 0;
+  pthread_mutex_destroy(&shm->hdr->lock);
+}
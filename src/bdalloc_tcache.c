@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <bdalloc_tcache.h>
+#include <pthread.h>
+
+typedef uint64_t u64;
+
+extern void bdalloc_shared_init(bdalloc_shared_t *shared,
+                                bdalloc_t *allocator) {
+  shared->allocator = allocator;
+  shared->remote_head = NULL;
+  pthread_mutex_init(&shared->lock, NULL);
+}
+
+/**
+ * Remote frees: an intrusive Treiber stack threaded through the dead blocks
+ * themselves (every block has at least 16 bytes of payload for the link).
+ *
+ * Producers publish with a compare-exchange that writes the link before the
+ * block becomes visible, so the consumer never sees a half-pushed node; a
+ * plain exchange-based push would leave a window where a node's link is
+ * unwritten and indistinguishable from the end of the stack. The consumer
+ * detaches the whole stack with a single exchange and frees it under the
+ * shared lock it is already holding.
+ */
+extern void bdalloc_shared_free(bdalloc_shared_t *shared, void *block) {
+  void *head = __atomic_load_n(&shared->remote_head, __ATOMIC_RELAXED);
+  do {
+    *(void **)block = head;
+  } while (!__atomic_compare_exchange_n(&shared->remote_head, &head, block, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Return every remotely freed block to the arena. Caller holds shared->lock;
+// the empty case is one relaxed load, so every lock site can afford this.
+static void remote_drain(bdalloc_shared_t *shared) {
+  if (__atomic_load_n(&shared->remote_head, __ATOMIC_RELAXED) == NULL)
+    return;
+
+  void *block = __atomic_exchange_n(&shared->remote_head, NULL,
+                                    __ATOMIC_ACQUIRE);
+  while (block != NULL) {
+    void *next = *(void **)block;
+    bdalloc_free(shared->allocator, block);
+    block = next;
+  }
+}
+
+extern void bdalloc_shared_deinit(bdalloc_shared_t *shared) {
+  pthread_mutex_destroy(&shared->lock);
+}
+
+extern void bdalloc_tcache_init(bdalloc_tcache_t *tcache,
+                                bdalloc_shared_t *shared) {
+  tcache->shared = shared;
+
+  for (int i = 0; i < _BD_MAX_MEM_ORDER; ++i) {
+    tcache->count[i] = 0;
+  }
+}
+
+/**
+ * Allocates SIZE bytes.
+ *
+ * The fast path pops a block off the calling thread's magazine for the
+ * request's order without taking any lock. When the magazine is empty the
+ * shared allocator is locked once and the magazine is refilled with several
+ * blocks, amortizing the lock over the next few allocations.
+ */
+extern void *bdalloc_tcache(bdalloc_tcache_t *tcache, u64 size) {
+  u64 order = bdalloc_alloc_order(size);
+
+  // Large blocks bypass the magazines entirely
+  if (order > _BD_TCACHE_MAX_ORDER) {
+    pthread_mutex_lock(&tcache->shared->lock);
+    remote_drain(tcache->shared);
+    void *mem = bdalloc(tcache->shared->allocator, size);
+    pthread_mutex_unlock(&tcache->shared->lock);
+
+    return mem;
+  }
+
+  // Uncontended hot path: pop from the magazine
+  if (tcache->count[order] > 0) {
+    tcache->count[order]--;
+
+    return tcache->magazine[order][tcache->count[order]];
+  }
+
+  // Magazine is empty: refill half of it under the shared lock, and hand the
+  // last block fetched to the caller.
+  void *mem = NULL;
+  pthread_mutex_lock(&tcache->shared->lock);
+  remote_drain(tcache->shared);
+  for (uint32_t i = 0; i < _BD_TCACHE_MAGAZINE_CAP / 2; ++i) {
+    void *blk = bdalloc(tcache->shared->allocator, size);
+    if (blk == NULL)
+      break;
+
+    if (mem != NULL) {
+      tcache->magazine[order][tcache->count[order]] = mem;
+      tcache->count[order]++;
+    }
+    mem = blk;
+  }
+  pthread_mutex_unlock(&tcache->shared->lock);
+
+  return mem;
+}
+
+/**
+ * Frees a block into the calling thread's magazine.
+ *
+ * When the magazine is full, half of it is returned to the shared allocator
+ * under the lock so blocks cached by an idle thread do not starve the rest.
+ */
+extern void bdalloc_tcache_free(bdalloc_tcache_t *tcache, void *block) {
+  u64 order = bdalloc_block_order(block);
+  assert(order < _BD_MAX_MEM_ORDER);
+
+  if (order > _BD_TCACHE_MAX_ORDER) {
+    pthread_mutex_lock(&tcache->shared->lock);
+    remote_drain(tcache->shared);
+    bdalloc_free(tcache->shared->allocator, block);
+    pthread_mutex_unlock(&tcache->shared->lock);
+
+    return;
+  }
+
+  // Magazine overfull: flush the older half back to the shared arena
+  if (tcache->count[order] == _BD_TCACHE_MAGAZINE_CAP) {
+    pthread_mutex_lock(&tcache->shared->lock);
+    remote_drain(tcache->shared);
+    for (uint32_t i = 0; i < _BD_TCACHE_MAGAZINE_CAP / 2; ++i) {
+      tcache->count[order]--;
+      bdalloc_free(tcache->shared->allocator,
+                   tcache->magazine[order][tcache->count[order]]);
+    }
+    pthread_mutex_unlock(&tcache->shared->lock);
+  }
+
+  tcache->magazine[order][tcache->count[order]] = block;
+  tcache->count[order]++;
+}
+
+extern void bdalloc_tcache_flush(bdalloc_tcache_t *tcache) {
+  pthread_mutex_lock(&tcache->shared->lock);
+  remote_drain(tcache->shared);
+  for (int order = 0; order < _BD_MAX_MEM_ORDER; ++order) {
+    while (tcache->count[order] > 0) {
+      tcache->count[order]--;
+      bdalloc_free(tcache->shared->allocator,
+                   tcache->magazine[order][tcache->count[order]]);
+    }
+  }
+  pthread_mutex_unlock(&tcache->shared->lock);
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <bdslab.h>
+#include <stdlib.h>
+
+typedef uint64_t u64;
+
+// aim for about this many objects per slab when sizing slab blocks
+#define _BD_SLAB_TARGET_OBJS 64
+
+// the smallest slab block worth carving up
+#define _BD_SLAB_MIN_SIZE 4096
+
+// objects start 8-aligned right after the slab header
+#define _BD_SLAB_OBJS_OFFSET ((sizeof(bdslab_slab_t) + 7) & ~(u64)7)
+
+static u64 next_power_of_two(u64 x) {
+  x--;
+
+  x |= x >> 1;
+  x |= x >> 2;
+  x |= x >> 4;
+  x |= x >> 8;
+  x |= x >> 16;
+  x |= x >> 32;
+
+  return ++x;
+}
+
+static char *slab_obj(bdslab_t *slab, bdslab_slab_t *s, u64 idx) {
+  return (char *)s + _BD_SLAB_OBJS_OFFSET + idx * slab->obj_size;
+}
+
+// list surgery over the prev/next fields of slab headers
+static void slab_list_push(bdslab_slab_t **list, bdslab_slab_t *s) {
+  s->prev = NULL;
+  s->next = *list;
+  if (*list != NULL)
+    (*list)->prev = s;
+  *list = s;
+}
+
+static void slab_list_remove(bdslab_slab_t **list, bdslab_slab_t *s) {
+  if (s->prev != NULL)
+    s->prev->next = s->next;
+  if (s->next != NULL)
+    s->next->prev = s->prev;
+  if (*list == s)
+    *list = s->next;
+
+  s->prev = NULL;
+  s->next = NULL;
+}
+
+extern void bdslab_init(bdslab_t *slab, bdalloc_t *allocator, u64 obj_size) {
+  // an object must be able to hold a freelist link
+  if (obj_size < 8)
+    obj_size = 8;
+  obj_size = (obj_size + 7) & ~(u64)7;
+
+  slab->allocator = allocator;
+  slab->obj_size = obj_size;
+  slab->slab_size = next_power_of_two(
+      _BD_SLAB_OBJS_OFFSET + obj_size * _BD_SLAB_TARGET_OBJS);
+  if (slab->slab_size < _BD_SLAB_MIN_SIZE)
+    slab->slab_size = _BD_SLAB_MIN_SIZE;
+  slab->objs_per_slab = (slab->slab_size - _BD_SLAB_OBJS_OFFSET) / obj_size;
+
+  slab->partial = NULL;
+  slab->full = NULL;
+}
+
+/**
+ * Allocates one object: pop the partial slab's freelist, or bump-allocate a
+ * never-used slot. A new slab block is fetched from the buddy allocator only
+ * when no partial slab exists.
+ */
+extern void *bdslab_alloc(bdslab_t *slab) {
+  if (slab->partial == NULL) {
+    bdslab_slab_t *fresh =
+        (bdslab_slab_t *)bdalloc_sized(slab->allocator, slab->slab_size);
+    if (fresh == NULL)
+      return NULL;
+
+    fresh->free_head = NULL;
+    fresh->used = 0;
+    fresh->bump = 0;
+    slab_list_push(&slab->partial, fresh);
+  }
+
+  bdslab_slab_t *s = slab->partial;
+
+  void *obj;
+  if (s->free_head != NULL) {
+    obj = s->free_head;
+    s->free_head = *(void **)obj;
+  } else {
+    obj = slab_obj(slab, s, s->bump);
+    s->bump++;
+  }
+  s->used++;
+
+  if (s->used == slab->objs_per_slab) {
+    slab_list_remove(&slab->partial, s);
+    slab_list_push(&slab->full, s);
+  }
+
+  return obj;
+}
+
+/**
+ * Frees one object back to its slab.
+ *
+ * The slab header is found arithmetically: slab blocks are slab_size-aligned
+ * relative to the owning arena's base, so masking the object's arena offset
+ * recovers the block start. An emptied slab is returned to the buddy
+ * allocator unless it is the only partial slab left, which keeps a
+ * single-object alloc/free churn from thrashing whole slab blocks.
+ */
+extern void bdslab_free(bdslab_t *slab, void *obj) {
+  bdalloc_t *owner = bdalloc_owning_arena(slab->allocator, obj);
+  assert(owner != NULL);
+
+  u64 offset = (u64)obj - (u64)owner->arena;
+  bdslab_slab_t *s =
+      (bdslab_slab_t *)((char *)owner->arena +
+                        (offset & ~(slab->slab_size - 1)));
+
+  if (s->used == slab->objs_per_slab) {
+    slab_list_remove(&slab->full, s);
+    slab_list_push(&slab->partial, s);
+  }
+
+  *(void **)obj = s->free_head;
+  s->free_head = obj;
+  s->used--;
+
+  if (s->used == 0 && (slab->partial != s || s->next != NULL)) {
+    slab_list_remove(&slab->partial, s);
+    bdalloc_free_sized(slab->allocator, s, slab->slab_size);
+  }
+}
+
+extern void bdslab_deinit(bdslab_t *slab) {
+  bdslab_slab_t *s = slab->partial;
+  while (s != NULL) {
+    bdslab_slab_t *next = s->next;
+    bdalloc_free_sized(slab->allocator, s, slab->slab_size);
+    s = next;
+  }
+
+  s = slab->full;
+  while (s != NULL) {
+    bdslab_slab_t *next = s->next;
+    bdalloc_free_sized(slab->allocator, s, slab->slab_size);
+    s = next;
+  }
+
+  slab->partial = NULL;
+  slab->full = NULL;
+}
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <bdalloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef uint64_t u64;
+
+// 64MB arena: big enough that no workload below exhausts it
+#define _BD_BENCH_ARENA (1UL << 26)
+
+#define _BD_BENCH_OPS 1000000UL
+
+// live-pointer window for the mixed-size workloads
+#define _BD_BENCH_SLOTS 1024
+
+static u64 now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u64)ts.tv_sec * 1000000000UL + (u64)ts.tv_nsec;
+}
+
+static u64 now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0; // no cheap cycle counter; ns/op still reported
+#endif
+}
+
+// xorshift64: fast, deterministic, and plenty random for workload shaping
+static u64 rng_state = 88172645463325252UL;
+
+static u64 rng() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+
+  return rng_state;
+}
+
+/**
+ * A Zipfian table of request sizes: order o (16B..4KB) appears with weight
+ * 1/rank, so small sizes dominate the way they do in real mixed workloads.
+ * Sampling is one rng() and one table load.
+ */
+#define _BD_BENCH_SIZE_TABLE 1024
+
+static u64 size_table[_BD_BENCH_SIZE_TABLE];
+
+static void size_table_init() {
+  double weights[9];
+  double total = 0.0;
+  for (int i = 0; i < 9; ++i) {
+    weights[i] = 1.0 / (double)(i + 1);
+    total += weights[i];
+  }
+
+  int at = 0;
+  for (int i = 0; i < 9; ++i) {
+    int n = (int)(weights[i] / total * _BD_BENCH_SIZE_TABLE);
+    for (int j = 0; j < n && at < _BD_BENCH_SIZE_TABLE; ++j)
+      size_table[at++] = 1UL << (4 + i);
+  }
+  while (at < _BD_BENCH_SIZE_TABLE)
+    size_table[at++] = 16;
+}
+
+static u64 zipf_size() { return size_table[rng() % _BD_BENCH_SIZE_TABLE]; }
+
+// every benchmarked pointer flows into this, so the compiler cannot elide an
+// alloc/free pair (gcc removes paired malloc/free wholesale at -O2)
+static volatile u64 sink;
+
+static void report(const char *name, u64 ops, u64 ns, u64 cycles) {
+  printf("%-32s %8.1f ns/op %10.1f cycles/op\n", name, (double)ns / (double)ops,
+         (double)cycles / (double)ops);
+}
+
+// Same-size alloc/free churn: the documented pathological case, where eager
+// coalescing merges on every free and re-splits on every alloc.
+static void bench_churn(const char *name, u64 lazy_watermark) {
+  bdalloc_t allocator;
+  assert(bdalloc_init(&allocator, _BD_BENCH_ARENA) != NULL);
+  bdalloc_set_lazy_coalesce(&allocator, lazy_watermark);
+
+  u64 ns = now_ns(), cyc = now_cycles();
+  for (u64 i = 0; i < _BD_BENCH_OPS; ++i) {
+    void *p = bdalloc(&allocator, 64);
+    sink += (u64)p;
+    bdalloc_free(&allocator, p);
+  }
+  report(name, 2 * _BD_BENCH_OPS, now_ns() - ns, now_cycles() - cyc);
+
+  bdalloc_deinit(&allocator);
+}
+
+static void bench_churn_malloc() {
+  u64 ns = now_ns(), cyc = now_cycles();
+  for (u64 i = 0; i < _BD_BENCH_OPS; ++i) {
+    void *p = malloc(64);
+    sink += (u64)p;
+    free(p);
+  }
+  report("churn 64B (malloc baseline)", 2 * _BD_BENCH_OPS, now_ns() - ns,
+         now_cycles() - cyc);
+}
+
+// Mixed-size Zipfian workload over a window of live pointers: each op evicts
+// a random slot and allocates a freshly sampled size into it.
+static void bench_zipf() {
+  bdalloc_t allocator;
+  assert(bdalloc_init(&allocator, _BD_BENCH_ARENA) != NULL);
+
+  void *slots[_BD_BENCH_SLOTS] = {0};
+
+  u64 ns = now_ns(), cyc = now_cycles();
+  for (u64 i = 0; i < _BD_BENCH_OPS; ++i) {
+    u64 at = rng() % _BD_BENCH_SLOTS;
+    if (slots[at] != NULL)
+      bdalloc_free(&allocator, slots[at]);
+    slots[at] = bdalloc(&allocator, zipf_size());
+    sink += (u64)slots[at];
+  }
+  report("zipf mixed sizes", _BD_BENCH_OPS, now_ns() - ns, now_cycles() - cyc);
+
+  for (u64 at = 0; at < _BD_BENCH_SLOTS; ++at)
+    if (slots[at] != NULL)
+      bdalloc_free(&allocator, slots[at]);
+  bdalloc_deinit(&allocator);
+}
+
+static void bench_zipf_malloc() {
+  void *slots[_BD_BENCH_SLOTS] = {0};
+
+  u64 ns = now_ns(), cyc = now_cycles();
+  for (u64 i = 0; i < _BD_BENCH_OPS; ++i) {
+    u64 at = rng() % _BD_BENCH_SLOTS;
+    free(slots[at]); // free(NULL) is a no-op
+    slots[at] = malloc(zipf_size());
+    sink += (u64)slots[at];
+  }
+  report("zipf mixed sizes (malloc)", _BD_BENCH_OPS, now_ns() - ns,
+         now_cycles() - cyc);
+
+  for (u64 at = 0; at < _BD_BENCH_SLOTS; ++at)
+    free(slots[at]);
+}
+
+// Fragmentation storm: shatter the arena into small blocks, free the odd
+// half (no merges possible), then the even half (every free cascades), which
+// exercises the full coalescing machinery.
+static void bench_storm() {
+  bdalloc_t allocator;
+  assert(bdalloc_init(&allocator, _BD_BENCH_ARENA) != NULL);
+
+  u64 n = _BD_BENCH_ARENA / 128 / 2; // half the arena as 128-byte blocks
+  void **blocks = (void **)malloc(n * sizeof(void *));
+
+  u64 ns = now_ns(), cyc = now_cycles();
+  for (u64 i = 0; i < n; ++i) {
+    blocks[i] = bdalloc(&allocator, 100);
+    sink += (u64)blocks[i];
+  }
+  for (u64 i = 1; i < n; i += 2)
+    bdalloc_free(&allocator, blocks[i]);
+  for (u64 i = 0; i < n; i += 2)
+    bdalloc_free(&allocator, blocks[i]);
+  report("fragmentation storm", 2 * n, now_ns() - ns, now_cycles() - cyc);
+
+  free(blocks);
+  bdalloc_deinit(&allocator);
+}
+
+// the monotonic startup pattern: allocate everything, free nothing (until
+// the teardown outside the timed window)
+static void bench_startup(const char *name, int use_bump) {
+  bdalloc_t allocator;
+  assert(bdalloc_init(&allocator, _BD_BENCH_ARENA) != NULL);
+
+  u64 n = _BD_BENCH_ARENA / 64 / 2; // half the arena as 64-byte blocks
+  void **blocks = (void **)malloc(n * sizeof(void *));
+
+  u64 ns = now_ns(), cyc = now_cycles();
+  if (use_bump)
+    assert(bdalloc_bump_begin(&allocator) == 0);
+  for (u64 i = 0; i < n; ++i) {
+    blocks[i] = bdalloc(&allocator, 56);
+    sink += (u64)blocks[i];
+  }
+  if (use_bump)
+    bdalloc_bump_end(&allocator);
+  report(name, n, now_ns() - ns, now_cycles() - cyc);
+
+  free(blocks);
+  bdalloc_deinit(&allocator);
+}
+
+int main() {
+  size_table_init();
+
+  bench_churn("churn 64B (eager coalesce)", 0);
+  bench_churn("churn 64B (lazy, watermark 8)", 8);
+  bench_churn_malloc();
+  bench_zipf();
+  bench_zipf_malloc();
+  bench_storm();
+  bench_startup("startup 64B (buddy path)", 0);
+  bench_startup("startup 64B (bump region)", 1);
+
+  return 0;
+}
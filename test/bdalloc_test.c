@@ -1,7 +1,1039 @@
 #include <assert.h>
 #include <bdalloc.h>
+#include <bdalloc_numa.h>
+#include <bdalloc_shm.h>
+#include <bdalloc_tcache.h>
+#include <bdslab.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// The tcache hot path should recycle blocks without touching the shared
+// allocator: the same addresses come back out of the magazine.
+static void test_tcache() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  bdalloc_shared_t shared;
+  bdalloc_shared_init(&shared, &allocator);
+
+  bdalloc_tcache_t tcache;
+  bdalloc_tcache_init(&tcache, &shared);
+
+  char *a = (char *)bdalloc_tcache(&tcache, 100);
+  char *b = (char *)bdalloc_tcache(&tcache, 100);
+  assert(a != NULL && b != NULL && a != b);
+
+  bdalloc_tcache_free(&tcache, b);
+  char *c = (char *)bdalloc_tcache(&tcache, 100);
+  assert(c == b);
+
+  bdalloc_tcache_free(&tcache, a);
+  bdalloc_tcache_free(&tcache, c);
+  bdalloc_tcache_flush(&tcache);
+
+  bdalloc_shared_deinit(&shared);
+  bdalloc_deinit(&allocator);
+  printf("test_tcache ok\n");
+}
+
+typedef struct remote_free_job_t {
+  bdalloc_shared_t *shared;
+  void **blocks;
+  int n;
+} remote_free_job_t;
+
+static void *remote_free_worker(void *arg) {
+  remote_free_job_t *job = (remote_free_job_t *)arg;
+  for (int i = 0; i < job->n; ++i)
+    bdalloc_shared_free(job->shared, job->blocks[i]);
+
+  return NULL;
+}
+
+// The pipeline pattern: one thread allocates, another frees. The freeing
+// side pushes onto the remote-free stack without locking; the blocks come
+// back to the arena when the allocating side next takes the shared lock.
+static void test_remote_free() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 16);
+  assert(arena != NULL);
+
+  bdalloc_shared_t shared;
+  bdalloc_shared_init(&shared, &allocator);
+
+  bdalloc_tcache_t tcache;
+  bdalloc_tcache_init(&tcache, &shared);
+
+  bdalloc_stats_t fresh;
+  bdalloc_stats(&allocator, &fresh);
+
+  void *blocks[4];
+  for (int i = 0; i < 4; ++i) {
+    blocks[i] = bdalloc_tcache(&tcache, 100);
+    assert(blocks[i] != NULL);
+  }
+
+  remote_free_job_t job = {&shared, blocks, 4};
+  pthread_t worker;
+  assert(pthread_create(&worker, NULL, remote_free_worker, &job) == 0);
+  pthread_join(worker, NULL);
+
+  // nothing is back in the arena until a lock site drains the stack
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 4 * 128);
+
+  bdalloc_tcache_flush(&tcache);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 0);
+  assert(st.bytes_free == fresh.bytes_free);
+  assert(st.fragmentation == 0.0); // the drain coalesced all the way back up
+
+  bdalloc_shared_deinit(&shared);
+  bdalloc_deinit(&allocator);
+  printf("test_remote_free ok\n");
+}
+
+#ifdef BDALLOC_CONCURRENT
+#define _BD_CONC_THREADS 4
+#define _BD_CONC_SLOTS 64
+#define _BD_CONC_ROUNDS 20000
+
+typedef struct concurrent_churn_job_t {
+  bdalloc_t *allocator;
+  uint64_t seed;
+} concurrent_churn_job_t;
+
+static void *concurrent_churn_worker(void *arg) {
+  concurrent_churn_job_t *job = (concurrent_churn_job_t *)arg;
+  uint64_t s = job->seed;
+  void *held[_BD_CONC_SLOTS] = {0};
+
+  for (int i = 0; i < _BD_CONC_ROUNDS; ++i) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+
+    int at = s & (_BD_CONC_SLOTS - 1);
+    if (held[at] != NULL)
+      bdalloc_free(job->allocator, held[at]);
+
+    uint64_t size = 16 + (s >> 32) % 1000; // spans orders 4 through 10
+    held[at] = bdalloc(job->allocator, size);
+    assert(held[at] != NULL);
+    memset(held[at], (int)(s & 0xFF), 16);
+  }
+
+  for (int at = 0; at < _BD_CONC_SLOTS; ++at)
+    if (held[at] != NULL)
+      bdalloc_free(job->allocator, held[at]);
+
+  return NULL;
+}
+
+// Mixed-order churn from several threads against one allocator, the workload
+// the per-order locks exist for. The mid-run asserts catch a lost order_mask
+// bit (a stranded freelist shows up as a spurious NULL); the post-join asserts
+// catch a lost pair-bit toggle (a skipped or bogus merge leaves the arena
+// fragmented after everything is freed). The instrumentation counters are
+// documented approximate under concurrency, so only the lock-protected
+// freelist state is checked.
+static void test_concurrent_churn() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 21);
+  assert(arena != NULL);
+
+  bdalloc_stats_t fresh;
+  bdalloc_stats(&allocator, &fresh);
+
+  concurrent_churn_job_t jobs[_BD_CONC_THREADS];
+  pthread_t workers[_BD_CONC_THREADS];
+  for (int i = 0; i < _BD_CONC_THREADS; ++i) {
+    jobs[i].allocator = &allocator;
+    jobs[i].seed = 88172645463325252UL + (uint64_t)i;
+    assert(pthread_create(&workers[i], NULL, concurrent_churn_worker,
+                          &jobs[i]) == 0);
+  }
+  for (int i = 0; i < _BD_CONC_THREADS; ++i)
+    pthread_join(workers[i], NULL);
+
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_free == fresh.bytes_free);
+  assert(st.fragmentation == 0.0); // everything coalesced back to one block
+
+  bdalloc_deinit(&allocator);
+  printf("test_concurrent_churn ok\n");
+}
+#endif
+
+// A freelist must survive holding more than two entries: fill the arena,
+// free every other pair-leader (so nothing coalesces), and take the freed
+// blocks back out again.
+static void test_freelist_depth() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  // 8192-byte arena, 128-byte blocks
+  char *blocks[64];
+  for (int i = 0; i < 64; ++i) {
+    blocks[i] = (char *)bdalloc(&allocator, 100);
+    assert(blocks[i] != NULL);
+  }
+
+  bdalloc_free(&allocator, blocks[0]);
+  bdalloc_free(&allocator, blocks[2]);
+  bdalloc_free(&allocator, blocks[4]);
+
+  assert(bdalloc(&allocator, 100) != NULL);
+  assert(bdalloc(&allocator, 100) != NULL);
+  assert(bdalloc(&allocator, 100) != NULL);
+
+  bdalloc_deinit(&allocator);
+  printf("test_freelist_depth ok\n");
+}
+
+// Freeing a block whose buddy has been split must not merge: the buddy's
+// region still contains a live smaller block. The pair bitmap tracks this per
+// order; the old header probe could not tell a free child apart from a free
+// buddy.
+static void test_no_merge_with_split_buddy() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *a = (char *)bdalloc(&allocator, 120); // order 7, offset 0
+  char *b = (char *)bdalloc(&allocator, 56);  // order 6, offset 128
+  char *c = (char *)bdalloc(&allocator, 56);  // order 6, offset 192
+  assert(a != NULL && b != NULL && c != NULL);
+
+  for (int i = 0; i < 56; ++i)
+    c[i] = 0x5a;
+
+  bdalloc_free(&allocator, b);
+  bdalloc_free(&allocator, a);
+
+  // a's buddy region is split and half-live, so a must come back as-is
+  char *d = (char *)bdalloc(&allocator, 120);
+  assert(d == a);
+  for (int i = 0; i < 120; ++i)
+    d[i] = 0x11;
+
+  for (int i = 0; i < 56; ++i)
+    assert(c[i] == 0x5a);
+
+  bdalloc_free(&allocator, d);
+  bdalloc_free(&allocator, c);
+  bdalloc_deinit(&allocator);
+  printf("test_no_merge_with_split_buddy ok\n");
+}
+
+// Sized (headerless) allocations pack at their exact power of two: two
+// 56-byte blocks land 64 bytes apart, where the header API would round each
+// up to 128. Frees must coalesce all the way back so the arena is reusable
+// at full size.
+static void test_sized() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *a = (char *)bdalloc_sized(&allocator, 56);
+  char *b = (char *)bdalloc_sized(&allocator, 56);
+  assert(a != NULL && b != NULL);
+  assert(b - a == 64 || a - b == 64);
+
+  bdalloc_free_sized(&allocator, b, 56);
+  bdalloc_free_sized(&allocator, a, 56);
+
+  // everything merged back: the whole arena is available again
+  char *big = (char *)bdalloc_sized(&allocator, 8192);
+  assert(big == (char *)arena);
+  bdalloc_free_sized(&allocator, big, 8192);
+
+  bdalloc_deinit(&allocator);
+  printf("test_sized ok\n");
+}
+
+// Aligned blocks must land on absolute alignment boundaries, including
+// alignments larger than the request, and a 4KB-aligned 4KB buffer must cost
+// exactly one 4KB block.
+static void test_aligned() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096); // 8192-byte arena
+  assert(arena != NULL);
+
+  char *line = (char *)bdalloc_aligned(&allocator, 64, 100);
+  assert(line != NULL && ((uint64_t)line & 63) == 0);
+
+  // alignment beyond the size bumps the order instead of offsetting
+  char *wide = (char *)bdalloc_aligned(&allocator, 1024, 16);
+  assert(wide != NULL && ((uint64_t)wide & 1023) == 0);
+
+  char *page = (char *)bdalloc_aligned(&allocator, 4096, 4096);
+  assert(page != NULL && ((uint64_t)page & 4095) == 0);
+
+  // the page buffer consumed one 4KB block, not two
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 128 + 1024 + 4096);
+
+  bdalloc_free_aligned(&allocator, page, 4096, 4096);
+  bdalloc_free_aligned(&allocator, wide, 1024, 16);
+  bdalloc_free_aligned(&allocator, line, 64, 100);
+
+  // everything merged back: the whole arena is available again
+  char *big = (char *)bdalloc_sized(&allocator, 8192);
+  assert(big == (char *)arena);
+  bdalloc_free_sized(&allocator, big, 8192);
+
+  bdalloc_deinit(&allocator);
+  printf("test_aligned ok\n");
+}
+
+// The compile-time order macro must agree with the runtime rounding, and an
+// order-direct allocation must be a normal header-carrying block.
+static void test_fixed_order() {
+  assert(BDALLOC_SIZE_ORDER(1) == bdalloc_alloc_order(1));
+  assert(BDALLOC_SIZE_ORDER(56) == bdalloc_alloc_order(56));
+  assert(BDALLOC_SIZE_ORDER(100) == bdalloc_alloc_order(100));
+  assert(BDALLOC_SIZE_ORDER(4096) == bdalloc_alloc_order(4096));
+  // >4GB sizes need the full 64-bit rounding cascade
+  assert(bdalloc_alloc_order((1UL << 32) - 8) == 32); // exactly 4GB with header
+  assert(BDALLOC_SIZE_ORDER((1UL << 32) - 7) ==
+         bdalloc_alloc_order((1UL << 32) - 7));
+
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *p = (char *)BDALLOC_FIXED(&allocator, 100);
+  assert(p != NULL);
+  assert(bdalloc_block_order(p) == bdalloc_alloc_order(100));
+
+  bdalloc_free(&allocator, p);
+  char *q = (char *)bdalloc(&allocator, 100); // interchangeable with bdalloc
+  assert(q == p);
+  bdalloc_free(&allocator, q);
+
+  bdalloc_deinit(&allocator);
+  printf("test_fixed_order ok\n");
+}
+
+// Under lazy coalescing a freed block stays at its own order until the
+// watermark trips, so same-size churn re-uses it directly; a big allocation
+// still succeeds because the failed search forces a full merge.
+static void test_lazy_coalesce() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  bdalloc_set_lazy_coalesce(&allocator, 4);
+
+  // churn: the freed block stays at its order and is handed out again
+  // without any re-splitting (entries attach after the list head, so it is
+  // one of the next two allocations)
+  char *a = (char *)bdalloc(&allocator, 100);
+  assert(a != NULL);
+  bdalloc_free(&allocator, a);
+  char *b = (char *)bdalloc(&allocator, 100);
+  char *c = (char *)bdalloc(&allocator, 100);
+  assert(b == a || c == a);
+  bdalloc_free(&allocator, b);
+  bdalloc_free(&allocator, c);
+
+  // everything is parked on low orders now; a full-arena request has to
+  // trigger the merge-and-retry path
+  char *big = (char *)bdalloc(&allocator, 8000);
+  assert(big != NULL);
+  bdalloc_free(&allocator, big);
+
+  bdalloc_deinit(&allocator);
+  printf("test_lazy_coalesce ok\n");
+}
+
+#ifdef BDALLOC_HARDENED
+// Freed blocks must be poisoned with 0xBD past the freelist link words (the
+// first 16 bytes of the block get rewritten when it is attached). Reading
+// the freed memory here is deliberate: the arena itself is still live.
+static void test_hardened_poison() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *p = (char *)bdalloc(&allocator, 100);
+  assert(p != NULL);
+  memset(p, 0xAA, 100);
+  bdalloc_free(&allocator, p);
+
+  // user offset 8 = block offset 16, just past the list links
+  assert((unsigned char)p[8] == 0xBD);
+  assert((unsigned char)p[40] == 0xBD);
+
+  bdalloc_deinit(&allocator);
+  printf("test_hardened_poison ok\n");
+}
+#endif
+
+// With a merge-level cap, a single free stops merging after k levels and the
+// deferred merges are recovered by the merge-and-retry path on allocation
+// failure.
+static void test_bounded_merge() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  bdalloc_set_max_merge_levels(&allocator, 2);
+
+  // carve the whole 8192-byte arena into 128-byte blocks and free them all;
+  // each free may climb at most 2 orders, so the top-order block is never
+  // reassembled directly
+  char *blocks[64];
+  for (int i = 0; i < 64; ++i) {
+    blocks[i] = (char *)bdalloc(&allocator, 100);
+    assert(blocks[i] != NULL);
+  }
+  for (int i = 0; i < 64; ++i)
+    bdalloc_free(&allocator, blocks[i]);
+  assert(allocator.orders[13].head == NULL);
+
+  // a full-arena request forces the deferred merges to finish
+  char *big = (char *)bdalloc(&allocator, 8000);
+  assert(big != NULL);
+  bdalloc_free(&allocator, big);
+
+  bdalloc_deinit(&allocator);
+  printf("test_bounded_merge ok\n");
+}
+
+// A growable allocator acquires new arenas instead of returning NULL, and
+// frees find their way back to the owning arena by address range.
+// Bump allocations must be pointer increments (no splits at all) yet come
+// out as ordinary buddy blocks: after sealing, freeing every one of them has
+// to coalesce the arena back to a single block.
+static void test_bump() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 16); // 131072-byte arena
+  assert(arena != NULL);
+
+  assert(bdalloc_bump_begin(&allocator) == 0);
+
+  // same-size allocations land back to back, 32 bytes apart
+  char *blocks[100];
+  for (int i = 0; i < 100; ++i) {
+    blocks[i] = (char *)bdalloc(&allocator, 24);
+    assert(blocks[i] != NULL);
+  }
+  for (int i = 1; i < 100; ++i)
+    assert(blocks[i] - blocks[i - 1] == 32);
+
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.split_count == 0); // the whole point
+  assert(st.bytes_in_use == 100 * 32);
+
+  // sealing returns the untouched tail to the freelists
+  bdalloc_bump_end(&allocator);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_free == 131072 - 100 * 32);
+
+  // a second begin is only legal after the first was sealed
+  assert(bdalloc_bump_begin(&allocator) == 0);
+  bdalloc_bump_end(&allocator);
+
+  for (int i = 0; i < 100; ++i)
+    bdalloc_free(&allocator, blocks[i]);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 0);
+  assert(st.fragmentation == 0.0);
+
+  bdalloc_deinit(&allocator);
+  printf("test_bump ok\n");
+}
+
+// Reserved orders must be O(1) on both ends: the pool feeds same-order
+// allocations ahead of the buddy machinery, same-order frees refill it, and
+// pinned blocks stay booked as in-use throughout.
+static void test_reserve() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 16);
+  assert(arena != NULL);
+
+  assert(bdalloc_reserve(&allocator, 7, 4) == 4);
+  assert(allocator.reserve[7].count == 4);
+
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 4 * 128);
+
+  // a reserved-order allocation comes from the pool, not the freelists, so
+  // nothing new is booked
+  char *p = (char *)bdalloc(&allocator, 100);
+  assert(p != NULL);
+  assert(allocator.reserve[7].count == 3);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 4 * 128);
+
+  // and its free refills the pool instead of coalescing
+  bdalloc_free(&allocator, p);
+  assert(allocator.reserve[7].count == 4);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 4 * 128);
+
+  // dropping the reservation hands everything back and coalesces clean
+  assert(bdalloc_reserve(&allocator, 7, 0) == 0);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 0);
+  assert(st.fragmentation == 0.0);
+
+  bdalloc_deinit(&allocator);
+  printf("test_reserve ok\n");
+}
+
+static void test_growable() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1024);
+  assert(arena != NULL);
+  bdalloc_set_growable(&allocator, 1);
+
+  // 2048-byte first arena; these cannot all fit in it
+  char *blocks[8];
+  for (int i = 0; i < 8; ++i) {
+    blocks[i] = (char *)bdalloc(&allocator, 1000);
+    assert(blocks[i] != NULL);
+  }
+  assert(allocator.next_arena != NULL);
+
+  for (int i = 0; i < 8; ++i)
+    bdalloc_free(&allocator, blocks[i]);
+
+  bdalloc_deinit(&allocator);
+  printf("test_growable ok\n");
+}
+
+static int map_calls = 0;
+static int unmap_calls = 0;
+
+static void *counting_map(uint64_t size, void *user) {
+  (void)user;
+  map_calls++;
+  return malloc(size);
+}
+
+static void counting_unmap(void *addr, uint64_t size, void *user) {
+  (void)size;
+  (void)user;
+  unmap_calls++;
+  free(addr);
+}
+
+// Custom backing callbacks receive every arena acquisition and release;
+// caller-provided arenas are adopted and never freed by deinit.
+static void test_custom_backing() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init_backed(&allocator, 1024, counting_map,
+                                    counting_unmap, NULL);
+  assert(arena != NULL);
+  assert(map_calls == 1);
+
+  char *p = (char *)bdalloc(&allocator, 512);
+  assert(p != NULL);
+  bdalloc_free(&allocator, p);
+
+  bdalloc_deinit(&allocator);
+  assert(unmap_calls == 1);
+
+  void *mem = malloc(2048);
+  assert(bdalloc_init_arena(&allocator, mem, 2048) == mem);
+  p = (char *)bdalloc(&allocator, 512);
+  assert(p != NULL);
+  bdalloc_free(&allocator, p);
+  bdalloc_deinit(&allocator);
+  free(mem); // still ours to release
+
+#ifdef __linux__
+  arena = bdalloc_init_mmap(&allocator, 1 << 20, 0);
+  assert(arena != NULL);
+  p = (char *)bdalloc(&allocator, 4096);
+  assert(p != NULL);
+  bdalloc_free(&allocator, p);
+  bdalloc_deinit(&allocator);
+#endif
+
+  printf("test_custom_backing ok\n");
+}
+
+// Init no longer touches the arena body, so bringing up a large allocator is
+// instant and pages fault in on demand. This is a correctness smoke test of
+// an arena too big to have been memset comfortably under ASan.
+static void test_large_arena_init() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, (1 << 28) - 8); // 256MB
+  assert(arena != NULL);
+
+  char *p = (char *)bdalloc(&allocator, 1 << 20);
+  assert(p != NULL);
+  p[0] = 1;
+  p[(1 << 20) - 1] = 1;
+  bdalloc_free(&allocator, p);
+
+  bdalloc_deinit(&allocator);
+  printf("test_large_arena_init ok\n");
+}
+
+// Growing into a free buddy and shrinking must happen in place; growth
+// blocked by a live buddy falls back to a copy with the data intact.
+static void test_realloc() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *a = (char *)bdalloc(&allocator, 100);
+  assert(a != NULL);
+  for (int i = 0; i < 100; ++i)
+    a[i] = (char)i;
+
+  // buddy is free: doubling absorbs it, no move
+  char *grown = (char *)bdalloc_realloc(&allocator, a, 200);
+  assert(grown == a);
+
+  // shrinking peels the tail back off, still no move
+  char *shrunk = (char *)bdalloc_realloc(&allocator, grown, 100);
+  assert(shrunk == a);
+
+  // occupy the buddy, then grow: must copy, preserving contents
+  char *blocker = (char *)bdalloc(&allocator, 100);
+  assert(blocker != NULL);
+  char *moved = (char *)bdalloc_realloc(&allocator, shrunk, 200);
+  assert(moved != NULL && moved != a);
+  for (int i = 0; i < 100; ++i)
+    assert(moved[i] == (char)i);
+
+  bdalloc_free(&allocator, moved);
+  bdalloc_free(&allocator, blocker);
+  bdalloc_deinit(&allocator);
+  printf("test_realloc ok\n");
+}
+
+// A bulk free of the whole batch must leave the arena fully coalesced, so a
+// top-order allocation succeeds right after.
+static void test_bulk() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  void *batch[32];
+  assert(bdalloc_bulk(&allocator, 100, batch, 32) == 32);
+
+  // return them out of order; the bulk free sorts and merges in one pass
+  void *shuffled[32];
+  for (int i = 0; i < 32; ++i)
+    shuffled[i] = batch[(i * 13) % 32];
+  bdalloc_free_bulk(&allocator, shuffled, 32);
+
+  char *big = (char *)bdalloc(&allocator, 8000);
+  assert(big != NULL);
+  bdalloc_free(&allocator, big);
+
+  bdalloc_deinit(&allocator);
+  printf("test_bulk ok\n");
+}
+
+#ifdef __linux__
+// Trimming a fully free arena must give back everything but the node page,
+// and a trimmed block must still be allocatable (its pages fault back in).
+static void test_trim() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 16384); // 32KB arena
+  assert(arena != NULL);
+
+  // one free order-15 block; the interior is all but the first page
+  uint64_t released = bdalloc_trim(&allocator, 0);
+  assert(released == 32768 - 4096);
+
+  // the block hasn't moved since, so a second trim has nothing new to advise
+  assert(bdalloc_trim(&allocator, 0) == 0);
+
+  char *p = (char *)bdalloc(&allocator, 10000);
+  assert(p != NULL);
+  memset(p, 0x77, 10000);
+  bdalloc_free(&allocator, p);
+
+  // the alloc/free cycle split and re-merged the arena, so the whole
+  // interior counts as resident again and trims in full
+  assert(bdalloc_trim(&allocator, 0) == 32768 - 4096);
+
+  // automatic mode: this free leaves the whole arena free, far above the
+  // watermark, so the excess is advised away on the spot
+  bdalloc_set_trim_watermark(&allocator, 4096);
+  char *q = (char *)bdalloc(&allocator, 100);
+  assert(q != NULL);
+  bdalloc_free(&allocator, q);
+
+  bdalloc_deinit(&allocator);
+  printf("test_trim ok\n");
+}
+
+// A snapshot round trip: user data survives by arena-relative offset, the
+// restored freelists keep working, and the original allocator is unharmed by
+// the in-place offset encoding the write does.
+static void test_snapshot() {
+  bdalloc_t allocator;
+  char *arena = (char *)bdalloc_init(&allocator, 4096);
+  assert(arena != NULL);
+
+  char *live = (char *)bdalloc(&allocator, 100);
+  char *dead = (char *)bdalloc(&allocator, 100);
+  assert(live != NULL && dead != NULL);
+  memset(live, 0x42, 100);
+  bdalloc_free(&allocator, dead); // leave a non-trivial freelist behind
+
+  char path[] = "/tmp/bdalloc_snap_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(bdalloc_snapshot(&allocator, fd) == 0);
+  assert(bdalloc(&allocator, 100) != NULL);
+
+  assert(lseek(fd, 0, SEEK_SET) == 0);
+  bdalloc_t restored;
+  char *base = (char *)bdalloc_restore(&restored, fd);
+  assert(base != NULL);
+  close(fd);
+  unlink(path);
+
+  // live data comes back at the same arena-relative offset
+  char *live2 = base + (live - arena);
+  for (int i = 0; i < 100; ++i)
+    assert(live2[i] == 0x42);
+
+  char *p = (char *)bdalloc(&restored, 100);
+  assert(p != NULL);
+  bdalloc_free(&restored, p);
+  bdalloc_free(&restored, live2);
+
+  bdalloc_deinit(&restored);
+  bdalloc_deinit(&allocator);
+  printf("test_snapshot ok\n");
+}
+
+// The NUMA wrapper routes allocations to the calling thread's node arena and
+// frees back to the owning arena by address range. Placement itself cannot
+// be asserted on a single-node box, but the routing can.
+static void test_numa() {
+  bdalloc_numa_t numa;
+  assert(bdalloc_numa_init(&numa, 2, 4096) == 0);
+
+  uint64_t node = bdalloc_numa_node(&numa);
+  assert(node < 2);
+
+  char *p = (char *)bdalloc_numa(&numa, 100);
+  assert(p != NULL);
+  assert(bdalloc_owning_arena(&numa.nodes[node], p) != NULL);
+
+  bdalloc_numa_free(&numa, p);
+
+  bdalloc_numa_deinit(&numa);
+  printf("test_numa ok\n");
+}
+
+// Two views of the same file mapped at different addresses stand in for two
+// processes: every piece of allocator state must survive the base change,
+// and only an offset crosses the "IPC boundary".
+static void test_shm() {
+  uint64_t foot = bdalloc_shm_footprint(1 << 16);
+
+  char path[] = "/tmp/bdalloc_shm_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(ftruncate(fd, (off_t)foot) == 0);
+
+  void *view_a = mmap(NULL, foot, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  void *view_b = mmap(NULL, foot, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(view_a != MAP_FAILED && view_b != MAP_FAILED && view_a != view_b);
+
+  bdalloc_shm_t producer, consumer;
+  assert(bdalloc_shm_init(&producer, view_a, 1 << 16) != NULL);
+  assert(bdalloc_attach(&consumer, view_b) != NULL);
+
+  // no passthrough here: a request beyond the arena (including >4GB sizes,
+  // which must survive the 64-bit rounding) fails cleanly
+  assert(bdalloc_shm(&producer, 1 << 16) == NULL);
+  assert(bdalloc_shm(&producer, (1UL << 32) - 7) == NULL);
+
+  char *msg = (char *)bdalloc_shm(&producer, 100);
+  assert(msg != NULL);
+  memset(msg, 0x42, 100);
+  uint64_t off = bdalloc_shm_offset(&producer, msg);
+
+  char *seen = (char *)bdalloc_shm_block(&consumer, off);
+  assert(seen != msg); // genuinely a different mapping
+  for (int i = 0; i < 100; ++i)
+    assert(seen[i] == 0x42);
+  bdalloc_shm_free(&consumer, seen);
+
+  // the consumer's free coalesced all the way back up: the whole arena is
+  // one block again and either side can take it
+  assert(producer.hdr->bytes_in_use == 0);
+  void *whole = bdalloc_shm(&consumer, (1 << 16) - 8);
+  assert(whole != NULL);
+  bdalloc_shm_free(&consumer, whole);
+
+  bdalloc_shm_deinit(&producer);
+  munmap(view_a, foot);
+  munmap(view_b, foot);
+  close(fd);
+  unlink(path);
+  printf("test_shm ok\n");
+}
+
+// A request beyond the arena's top order must come from its own mapping --
+// leaving the arena untouched -- and still free through plain bdalloc_free.
+static void test_large() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096); // 8192-byte arena
+  assert(arena != NULL);
+
+  char *big = (char *)bdalloc(&allocator, 1 << 20);
+  assert(big != NULL);
+  assert(bdalloc_owning_arena(&allocator, big) == NULL);
+  big[0] = 1;
+  big[(1 << 20) - 1] = 2;
+
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 1 << 20); // page-rounded, not power-of-two
+  assert(st.bytes_in_use == 0);      // the arena never saw it
+
+  bdalloc_free(&allocator, big);
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 0);
+
+  // ordinary requests still take the arena path
+  void *p = bdalloc(&allocator, 100);
+  assert(p != NULL);
+  assert(bdalloc_owning_arena(&allocator, p) != NULL);
+  bdalloc_free(&allocator, p);
+
+  // realloc resizes passthrough blocks at the mapping level, preserving the
+  // data even when the kernel moves the pages
+  char *q = (char *)bdalloc(&allocator, 1 << 20);
+  assert(q != NULL);
+  memset(q, 0x5A, 1 << 20);
+  q = (char *)bdalloc_realloc(&allocator, q, 1 << 22);
+  assert(q != NULL);
+  assert(q[0] == 0x5A && q[(1 << 20) - 1] == 0x5A);
+  q[(1 << 22) - 1] = 3;
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 1 << 22);
+
+  // shrinking stays at the mapping level too, even at arena-sized requests
+  q = (char *)bdalloc_realloc(&allocator, q, 64);
+  assert(q != NULL);
+  assert(q[0] == 0x5A);
+  assert(bdalloc_owning_arena(&allocator, q) == NULL);
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 4096);
+
+  // free_bulk takes mixed batches: arena blocks coalesce, passthrough
+  // blocks go back to the system
+  void *batch[3];
+  batch[0] = bdalloc(&allocator, 100);
+  batch[1] = q;
+  batch[2] = bdalloc(&allocator, 1 << 21);
+  assert(batch[0] != NULL && batch[2] != NULL);
+  bdalloc_free_bulk(&allocator, batch, 3);
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 0);
+  assert(st.bytes_in_use == 0);
+  assert(st.fragmentation == 0.0);
+
+  // a >4GB request must round with the full 64-bit cascade and route here
+  // too; the pages are lazily faulted, so only the ones touched cost anything
+  char *huge = (char *)bdalloc(&allocator, (1UL << 32) - 7);
+  assert(huge != NULL);
+  huge[0] = 1;
+  huge[(1UL << 32) - 8] = 2;
+  bdalloc_stats(&allocator, &st);
+  assert(st.large_bytes == 1UL << 32);
+  bdalloc_free(&allocator, huge);
+
+  // a passthrough block never freed is reclaimed by deinit
+  assert(bdalloc(&allocator, 123456) != NULL);
+  bdalloc_deinit(&allocator);
+  printf("test_large ok\n");
+}
+#endif
+
+// The stats counters must track the rounded block sizes through an
+// alloc/free cycle, and fragmentation must return to 0 once the arena is
+// whole again.
+static void test_stats() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096); // 8192-byte arena
+  assert(arena != NULL);
+
+  bdalloc_stats_t st;
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 0);
+  assert(st.bytes_free == 8192);
+  assert(st.open_pairs == 0);
+  assert(st.fragmentation == 0.0);
+
+  // 100 bytes + header rounds to a 128-byte block, split down from the top
+  char *p = (char *)bdalloc(&allocator, 100);
+  assert(p != NULL);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 128);
+  assert(st.peak_in_use == 128);
+  assert(st.bytes_free == 8192 - 128);
+  assert(st.split_count == 6); // order 13 down to order 7
+  assert(st.free_bytes_per_order[7] == 128);
+  assert(st.open_pairs == 6); // each split left one free half behind
+  assert(st.fragmentation > 0.0);
+
+  bdalloc_free(&allocator, p);
+  bdalloc_stats(&allocator, &st);
+  assert(st.bytes_in_use == 0);
+  assert(st.peak_in_use == 128);
+  assert(st.bytes_free == 8192);
+  assert(st.coalesce_count == 6);
+  assert(st.open_pairs == 0);
+  assert(st.fragmentation == 0.0);
+
+  bdalloc_deinit(&allocator);
+  printf("test_stats ok\n");
+}
+
+#ifdef BDALLOC_TRACE
+// One alloc/free round trip on a fresh arena has an exact event sequence:
+// six splits down to order 7, the alloc, the free, six merges back up.
+static void test_trace() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 4096); // 8192-byte arena
+  assert(arena != NULL);
+
+  static bdalloc_trace_event_t ring[64];
+  bdalloc_set_trace_buffer(ring, 64);
+
+  void *p = bdalloc(&allocator, 100);
+  assert(p != NULL);
+  bdalloc_free(&allocator, p);
+
+  assert(bdalloc_trace_count() == 14);
+  assert(ring[0].op == BDALLOC_TRACE_SPLIT);
+  assert(ring[6].op == BDALLOC_TRACE_ALLOC);
+  assert(ring[6].order == 7);
+  assert(ring[6].addr == p);
+  assert(ring[7].op == BDALLOC_TRACE_FREE);
+  assert(ring[13].op == BDALLOC_TRACE_MERGE);
+
+  // the dump is collapsed-stack lines flamegraph.pl accepts directly
+  FILE *folded = tmpfile();
+  assert(folded != NULL);
+  bdalloc_trace_dump(folded);
+  fseek(folded, 0, SEEK_SET);
+  char line[128];
+  assert(fgets(line, sizeof(line), folded) != NULL);
+  assert(strncmp(line, "bdalloc;", 8) == 0);
+  fclose(folded);
+
+  bdalloc_set_trace_buffer(NULL, 0);
+  bdalloc_deinit(&allocator);
+  printf("test_trace ok\n");
+}
+#endif
+
+static void test_epoch() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 16);
+  assert(arena != NULL);
+
+  // state that outlives the epoch
+  char *keep = (char *)bdalloc(&allocator, 100);
+  assert(keep != NULL);
+  memset(keep, 0x5A, 100);
+
+  bdalloc_stats_t before;
+  bdalloc_stats(&allocator, &before);
+
+  assert(bdalloc_epoch_begin(&allocator) == 0);
+
+  // a request loop: many temporaries per iteration, zero frees -- the reset
+  // is the free
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 50; ++i)
+      assert(bdalloc(&allocator, 64 + i) != NULL);
+    bdalloc_epoch_reset(&allocator);
+  }
+
+  // everything allocated in the epoch is gone, everything before it intact
+  bdalloc_stats_t after;
+  bdalloc_stats(&allocator, &after);
+  assert(after.bytes_in_use == before.bytes_in_use);
+  assert(after.bytes_free == before.bytes_free);
+  for (int i = 0; i < 100; ++i)
+    assert(keep[i] == 0x5A);
+
+  // the restored freelists must be coherent: allocate, free, and coalesce
+  // back to a clean arena
+  bdalloc_epoch_end(&allocator);
+  bdalloc_free(&allocator, keep);
+  char *big = (char *)bdalloc(&allocator, (1 << 15) - 8);
+  assert(big != NULL);
+  bdalloc_free(&allocator, big);
+
+  bdalloc_deinit(&allocator);
+  printf("test_epoch ok\n");
+}
+
+// 40-byte objects must pack at 40-byte strides inside a slab (no
+// power-of-two rounding, no header) and freed slots must be recycled.
+static void test_slab() {
+  bdalloc_t allocator;
+  void *arena = bdalloc_init(&allocator, 1 << 16);
+  assert(arena != NULL);
+
+  bdslab_t slab;
+  bdslab_init(&slab, &allocator, 40);
+
+  char *o1 = (char *)bdslab_alloc(&slab);
+  char *o2 = (char *)bdslab_alloc(&slab);
+  assert(o1 != NULL && o2 != NULL);
+  assert(o2 - o1 == 40);
+
+  bdslab_free(&slab, o1);
+  char *o3 = (char *)bdslab_alloc(&slab);
+  assert(o3 == o1); // freed slot recycled
+
+  // fill past one slab so a second slab block gets carved
+  char *objs[256];
+  for (int i = 0; i < 256; ++i) {
+    objs[i] = (char *)bdslab_alloc(&slab);
+    assert(objs[i] != NULL);
+    objs[i][0] = (char)i;
+  }
+  for (int i = 0; i < 256; ++i)
+    bdslab_free(&slab, objs[i]);
+  bdslab_free(&slab, o2);
+  bdslab_free(&slab, o3);
+
+  bdslab_deinit(&slab);
+
+  // all slab blocks returned: the arena coalesces back whole
+  char *big = (char *)bdalloc(&allocator, (1 << 17) - 8);
+  assert(big != NULL);
+  bdalloc_free(&allocator, big);
+
+  bdalloc_deinit(&allocator);
+  printf("test_slab ok\n");
+}
 
 int main() {
   bdalloc_t allocator;
@@ -26,4 +1058,40 @@ int main() {
   bdalloc_free(&allocator, r);
 
   bdalloc_deinit(&allocator);
+
+  test_freelist_depth();
+  test_no_merge_with_split_buddy();
+  test_sized();
+  test_aligned();
+  test_fixed_order();
+  test_lazy_coalesce();
+  test_bounded_merge();
+#ifdef BDALLOC_HARDENED
+  test_hardened_poison();
+#endif
+  test_bump();
+  test_reserve();
+  test_growable();
+  test_custom_backing();
+  test_large_arena_init();
+  test_realloc();
+  test_bulk();
+  test_stats();
+#ifdef BDALLOC_TRACE
+  test_trace();
+#endif
+  test_epoch();
+#ifdef __linux__
+  test_trim();
+  test_snapshot();
+  test_numa();
+  test_shm();
+  test_large();
+#endif
+  test_slab();
+  test_tcache();
+  test_remote_free();
+#ifdef BDALLOC_CONCURRENT
+  test_concurrent_churn();
+#endif
 }